@@ -1,89 +1,326 @@
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
 #include <iostream>
-#include <set>
+#include <string>
+#include <thread>
 #include <vector>
 
-using topographic_map = std::vector<std::vector<std::size_t>>;
+constexpr std::uint8_t trailhead_height = 0;
+constexpr std::uint8_t peak_height = 9;
+// Height of cells that are not part of any trail
+constexpr std::uint8_t impassable = 0xff;
+
+struct topographic_map {
+    int num_rows = 0;
+    int num_cols = 0;
+    std::vector<std::uint8_t> heights;
+
+    int num_cells() const { return num_rows * num_cols; }
+};
 
 topographic_map read_input(std::istream &istream) {
     topographic_map map;
 
     std::string line;
     while (std::getline(istream, line)) {
-        std::vector<std::size_t> heights;
-        heights.reserve(line.size());
+        if (map.num_rows == 0) {
+            map.num_cols = static_cast<int>(line.size());
+        } else if (static_cast<int>(line.size()) != map.num_cols) {
+            throw std::runtime_error("Invalid input: rows of different length");
+        }
 
-        std::transform(line.cbegin(), line.cend(), std::back_inserter(heights),
-                       [](char c) { return static_cast<std::size_t>(c - '0'); });
-        map.emplace_back(std::move(heights));
+        std::transform(line.cbegin(), line.cend(), std::back_inserter(map.heights), [](char c) {
+            return '0' <= c && c <= '9' ? static_cast<std::uint8_t>(c - '0') : impassable;
+        });
+        ++map.num_rows;
     }
     return map;
 }
 
 void print_map(const topographic_map &map) {
-    for (const auto &row : map) {
-        for (const auto col : row) {
-            std::clog << col;
+    for (int row = 0; row < map.num_rows; ++row) {
+        for (int col = 0; col < map.num_cols; ++col) {
+            const auto height = map.heights[row * map.num_cols + col];
+            std::clog << (height == impassable ? '.' : static_cast<char>('0' + height));
         }
         std::clog << "\n";
     }
 }
 
-std::vector<std::pair<std::size_t, std::size_t>> step(std::size_t row, std::size_t col,
-                                                      const topographic_map &map) {
-    const auto height = map[row][col];
-    if (height == 9) {
-        return {std::make_pair(row, col)};
+// Cells grouped by height, group h is [offsets[h], offsets[h + 1])
+struct height_layers {
+    std::array<std::size_t, peak_height + 2> offsets{};
+    std::vector<int> cells;
+};
+
+height_layers layer_by_height(const topographic_map &map) {
+    height_layers layers;
+    for (const auto height : map.heights) {
+        if (height <= peak_height) {
+            ++layers.offsets[height + 1];
+        }
+    }
+    for (std::size_t h = 1; h < layers.offsets.size(); ++h) {
+        layers.offsets[h] += layers.offsets[h - 1];
+    }
+
+    auto next = layers.offsets;
+    layers.cells.resize(layers.offsets.back());
+    for (int cell = 0; cell < map.num_cells(); ++cell) {
+        const auto height = map.heights[cell];
+        if (height <= peak_height) {
+            layers.cells[next[height]++] = cell;
+        }
     }
+    return layers;
+}
 
-    std::vector<std::pair<std::size_t, std::size_t>> peaks;
+// Calls fn(neighbor) for every neighbor of `cell` that is one step higher
+template <typename Fn> void for_each_uphill(const topographic_map &map, int cell, Fn &&fn) {
+    const auto row = cell / map.num_cols;
+    const auto col = cell % map.num_cols;
+    const auto next_height = map.heights[cell] + 1;
 
     // North
-    if (row > 0 && map[row - 1][col] == height + 1) {
-        const auto ends = step(row - 1, col, map);
-        std::copy(ends.cbegin(), ends.cend(), std::back_inserter(peaks));
+    if (row > 0 && map.heights[cell - map.num_cols] == next_height) {
+        fn(cell - map.num_cols);
     }
     // East
-    if (col < map[row].size() - 1 && map[row][col + 1] == height + 1) {
-        const auto ends = step(row, col + 1, map);
-        std::copy(ends.cbegin(), ends.cend(), std::back_inserter(peaks));
+    if (col + 1 < map.num_cols && map.heights[cell + 1] == next_height) {
+        fn(cell + 1);
     }
     // South
-    if (row < map.size() - 1 && map[row + 1][col] == height + 1) {
-        const auto ends = step(row + 1, col, map);
-        std::copy(ends.cbegin(), ends.cend(), std::back_inserter(peaks));
+    if (row + 1 < map.num_rows && map.heights[cell + map.num_cols] == next_height) {
+        fn(cell + map.num_cols);
     }
     // West
-    if (col > 0 && map[row][col - 1] == height + 1) {
-        const auto ends = step(row, col - 1, map);
-        std::copy(ends.cbegin(), ends.cend(), std::back_inserter(peaks));
+    if (col > 0 && map.heights[cell - 1] == next_height) {
+        fn(cell - 1);
+    }
+}
+
+struct trail_totals {
+    std::size_t score = 0;
+    std::size_t rating = 0;
+};
+
+// Dynamic programming over the cells from the peaks down to the trailheads: the number of trails
+// to a peak (rating) is the sum over the uphill neighbors and the set of reachable peaks (score)
+// is the union of their peak bitsets.
+trail_totals rate_trails(const topographic_map &map) {
+    const auto layers = layer_by_height(map);
+    const auto peaks_begin = layers.cells.cbegin() + layers.offsets[peak_height];
+    const auto peaks_end = layers.cells.cbegin() + layers.offsets[peak_height + 1];
+    const auto num_peaks = static_cast<std::size_t>(peaks_end - peaks_begin);
+    const auto words = (num_peaks + 63) / 64;
+
+    std::vector<std::size_t> num_trails(map.num_cells());
+    std::vector<std::uint64_t> reachable(static_cast<std::size_t>(map.num_cells()) * words);
+
+    std::size_t peak = 0;
+    for (auto it = peaks_begin; it != peaks_end; ++it, ++peak) {
+        num_trails[*it] = 1;
+        reachable[*it * words + peak / 64] |= std::uint64_t{1} << (peak % 64);
+    }
+
+    for (int height = peak_height - 1; height >= 0; --height) {
+        for (auto i = layers.offsets[height]; i < layers.offsets[height + 1]; ++i) {
+            const auto cell = layers.cells[i];
+            const auto peaks = reachable.begin() + static_cast<std::size_t>(cell) * words;
+            for_each_uphill(map, cell, [&](int neighbor) {
+                num_trails[cell] += num_trails[neighbor];
+                const auto neighbor_peaks = reachable.cbegin() + neighbor * words;
+                for (std::size_t w = 0; w < words; ++w) {
+                    peaks[w] |= neighbor_peaks[w];
+                }
+            });
+        }
     }
 
-    return peaks;
+    trail_totals totals;
+    for (auto i = layers.offsets[trailhead_height]; i < layers.offsets[trailhead_height + 1];
+         ++i) {
+        const auto cell = layers.cells[i];
+        const auto peaks = reachable.cbegin() + static_cast<std::size_t>(cell) * words;
+        for (std::size_t w = 0; w < words; ++w) {
+            totals.score += std::popcount(peaks[w]);
+        }
+        totals.rating += num_trails[cell];
+    }
+    return totals;
 }
 
-int main() {
-    const auto map = read_input(std::cin);
+// Tiled mode for maps where a peak bitset per cell does not fit into memory. Every trail lies
+// within max_trail_length steps of its peak, so the trails to the peaks of one tile stay inside
+// the tile grown by that margin. Tiles are processed in parallel; the peaks of a tile are scored
+// in batches of Width bits and the rating DP only counts trails ending in the tile. Memory per
+// thread depends on the tile size and Width, not on the number of peaks.
+template <std::size_t Width>
+trail_totals rate_trails_tiled(const topographic_map &map, int tile_size = 64) {
+    static_assert(Width % 64 == 0);
+    constexpr auto words = Width / 64;
+    constexpr int max_trail_length = peak_height - trailhead_height;
+    using peak_mask = std::array<std::uint64_t, words>;
+
+    const auto tile_rows = (map.num_rows + tile_size - 1) / tile_size;
+    const auto tile_cols = (map.num_cols + tile_size - 1) / tile_size;
+    const auto num_tiles = static_cast<std::size_t>(tile_rows) * tile_cols;
+    const auto num_threads = std::max<std::size_t>(
+        1, std::min<std::size_t>(std::thread::hardware_concurrency(), num_tiles));
+
+    std::atomic<std::size_t> next_tile = 0;
+    std::atomic<std::size_t> total_score = 0;
+    std::atomic<std::size_t> total_rating = 0;
+    {
+        std::vector<std::jthread> workers;
+        for (std::size_t t = 0; t < num_threads; ++t) {
+            workers.emplace_back([&]() {
+                std::vector<int> peaks;
+                std::array<std::size_t, peak_height + 2> offsets;
+                std::vector<int> cells;
+                std::vector<std::size_t> num_trails;
+                std::vector<peak_mask> reachable;
+
+                for (auto tile = next_tile++; tile < num_tiles; tile = next_tile++) {
+                    const auto tile_row = static_cast<int>(tile / tile_cols) * tile_size;
+                    const auto tile_col = static_cast<int>(tile % tile_cols) * tile_size;
+                    const auto row_begin = std::max(0, tile_row - max_trail_length);
+                    const auto row_end =
+                        std::min(map.num_rows, tile_row + tile_size + max_trail_length);
+                    const auto col_begin = std::max(0, tile_col - max_trail_length);
+                    const auto col_end =
+                        std::min(map.num_cols, tile_col + tile_size + max_trail_length);
+                    const auto width = col_end - col_begin;
+                    const auto region_size = (row_end - row_begin) * width;
+
+                    auto height_at = [&](int local) {
+                        return map.heights[(row_begin + local / width) * map.num_cols +
+                                           col_begin + local % width];
+                    };
+
+                    // Peaks of the tile as indices into the region
+                    peaks.clear();
+                    for (auto row = tile_row; row < std::min(map.num_rows, tile_row + tile_size);
+                         ++row) {
+                        for (auto col = tile_col;
+                             col < std::min(map.num_cols, tile_col + tile_size); ++col) {
+                            if (map.heights[row * map.num_cols + col] == peak_height) {
+                                peaks.push_back((row - row_begin) * width + col - col_begin);
+                            }
+                        }
+                    }
+                    if (peaks.empty()) {
+                        continue;
+                    }
+
+                    // Region cells grouped by height
+                    offsets.fill(0);
+                    for (int local = 0; local < region_size; ++local) {
+                        if (const auto height = height_at(local); height <= peak_height) {
+                            ++offsets[height + 1];
+                        }
+                    }
+                    for (std::size_t h = 1; h < offsets.size(); ++h) {
+                        offsets[h] += offsets[h - 1];
+                    }
+                    auto next = offsets;
+                    cells.resize(offsets.back());
+                    for (int local = 0; local < region_size; ++local) {
+                        if (const auto height = height_at(local); height <= peak_height) {
+                            cells[next[height]++] = local;
+                        }
+                    }
 
-    std::size_t total_score = 0;
-    std::size_t total_rating = 0;
-    for (std::size_t row = 0; row < map.size(); ++row) {
-        for (std::size_t col = 0; col < map[row].size(); ++col) {
-            const auto height = map[row][col];
-            if (height != 0) {
-                continue;
-            }
-            const auto trail_endings = step(row, col, map);
-            const std::set<decltype(trail_endings)::value_type> unique_trail_endings(
-                trail_endings.cbegin(), trail_endings.cend());
-
-            const auto trailhead_score = unique_trail_endings.size();
-            const auto trailhead_rating = trail_endings.size();
-            total_score += trailhead_score;
-            total_rating += trailhead_rating;
+                    auto for_each_uphill_local = [&](int local, auto &&fn) {
+                        const auto row = local / width;
+                        const auto col = local % width;
+                        const auto next_height = height_at(local) + 1;
+                        if (row > 0 && height_at(local - width) == next_height) {
+                            fn(local - width);
+                        }
+                        if (col + 1 < width && height_at(local + 1) == next_height) {
+                            fn(local + 1);
+                        }
+                        if (row + 1 < row_end - row_begin &&
+                            height_at(local + width) == next_height) {
+                            fn(local + width);
+                        }
+                        if (col > 0 && height_at(local - 1) == next_height) {
+                            fn(local - 1);
+                        }
+                    };
+                    auto for_each_layer_cell = [&](auto &&fn) {
+                        for (int height = peak_height - 1; height >= 0; --height) {
+                            for (auto i = offsets[height]; i < offsets[height + 1]; ++i) {
+                                fn(cells[i]);
+                            }
+                        }
+                    };
+
+                    // Rating of the trails ending in this tile
+                    num_trails.assign(region_size, 0);
+                    for (const auto peak : peaks) {
+                        num_trails[peak] = 1;
+                    }
+                    for_each_layer_cell([&](int local) {
+                        for_each_uphill_local(local, [&](int neighbor) {
+                            num_trails[local] += num_trails[neighbor];
+                        });
+                    });
+                    std::size_t rating = 0;
+                    for (auto i = offsets[trailhead_height]; i < offsets[trailhead_height + 1];
+                         ++i) {
+                        rating += num_trails[cells[i]];
+                    }
+                    total_rating += rating;
+
+                    // Score, one batch of Width peaks at a time
+                    std::size_t score = 0;
+                    for (std::size_t batch = 0; batch < peaks.size(); batch += Width) {
+                        reachable.assign(region_size, peak_mask{});
+                        const auto batch_end = std::min(peaks.size(), batch + Width);
+                        for (auto p = batch; p < batch_end; ++p) {
+                            const auto bit = p - batch;
+                            reachable[peaks[p]][bit / 64] |= std::uint64_t{1} << (bit % 64);
+                        }
+                        for_each_layer_cell([&](int local) {
+                            for_each_uphill_local(local, [&](int neighbor) {
+                                for (std::size_t w = 0; w < words; ++w) {
+                                    reachable[local][w] |= reachable[neighbor][w];
+                                }
+                            });
+                        });
+                        for (auto i = offsets[trailhead_height]; i < offsets[trailhead_height + 1];
+                             ++i) {
+                            for (const auto word : reachable[cells[i]]) {
+                                score += std::popcount(word);
+                            }
+                        }
+                    }
+                    total_score += score;
+                }
+            });
         }
     }
 
+    return {.score = total_score, .rating = total_rating};
+}
+
+// Beyond this many bytes of peak bitsets the tiled mode is used
+constexpr std::size_t max_bitset_bytes = std::size_t{1} << 30;
+
+int main() {
+    const auto map = read_input(std::cin);
+
+    const auto num_peaks = std::count(map.heights.cbegin(), map.heights.cend(), peak_height);
+    const auto bitset_bytes =
+        static_cast<std::size_t>(map.num_cells()) * ((num_peaks + 63) / 64) * sizeof(std::uint64_t);
+    const auto [total_score, total_rating] =
+        bitset_bytes <= max_bitset_bytes ? rate_trails(map) : rate_trails_tiled<256>(map);
+
     std::cout << "Part 1: " << total_score << "\n";
     std::cout << "Part 2: " << total_rating << "\n";
 
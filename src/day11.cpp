@@ -1,8 +1,15 @@
 #include <algorithm>
-#include <cmath>
+#include <array>
+#include <bit>
+#include <cstdint>
 #include <iostream>
 #include <iterator>
-#include <map>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -18,16 +25,46 @@ std::vector<IntType> read_input(std::istream &istream) {
     return result;
 }
 
+// pow10[d] == 10^d for every power of ten representable in IntType
+constexpr auto pow10 = [] {
+    std::array<IntType, std::numeric_limits<IntType>::digits10 + 1> table{};
+    IntType power = 1;
+    for (std::size_t d = 0; d < table.size(); ++d) {
+        table[d] = power;
+        if (d + 1 < table.size()) {
+            power *= 10;
+        }
+    }
+    return table;
+}();
+
+// Number of decimal digits of the largest number with the given bit width. The digits of a
+// number are either this or one less, which a single comparison with pow10 decides.
+constexpr auto max_digits_by_bit_width = [] {
+    std::array<std::size_t, std::numeric_limits<IntType>::digits + 1> table{};
+    for (std::size_t bits = 1; bits < table.size(); ++bits) {
+        auto largest = (IntType{1} << (bits - 1)) - 1 + (IntType{1} << (bits - 1));
+        std::size_t digits = 0;
+        for (; largest >= 1; largest /= 10) {
+            ++digits;
+        }
+        table[bits] = digits;
+    }
+    return table;
+}();
+
 std::size_t get_num_digits(IntType num) {
-    std::size_t digits = 0;
-    while (num >= 1) {
-        num /= 10;
-        ++digits;
+    if (num <= 0) {
+        return 0;
     }
-    return digits;
+    const auto digits = max_digits_by_bit_width[std::bit_width(static_cast<std::uint64_t>(num))];
+    return num < pow10[digits - 1] ? digits - 1 : digits;
 }
 
 IntType intpow(IntType base, std::size_t exp) {
+    if (base == 10 && exp < pow10.size()) {
+        return pow10[exp];
+    }
     IntType result = 1;
     for (; exp > 0; --exp) {
         result *= base;
@@ -49,66 +86,427 @@ std::variant<IntType, std::pair<IntType, IntType>> blink(IntType stone) {
     return 2024 * stone;
 }
 
-std::vector<IntType> blink(std::vector<IntType>::const_iterator begin,
-                           std::vector<IntType>::const_iterator end) {
+// Open addressing hash map from stone value to number of stones with linear probing. clear()
+// keeps the allocation, so two tables can be swapped between generations without allocating.
+class stone_counts {
+  public:
+    explicit stone_counts(std::size_t capacity = 1 << 12)
+        : keys(std::bit_ceil(std::max<std::size_t>(2 * capacity, 16)), empty),
+          counts(keys.size()) {}
+
+    void add(IntType stone, std::size_t count) {
+        if (2 * (num_keys + 1) > keys.size()) {
+            grow();
+        }
+        counts[find_slot(stone)] += count;
+    }
+
+    void clear() {
+        std::fill(keys.begin(), keys.end(), empty);
+        std::fill(counts.begin(), counts.end(), 0);
+        num_keys = 0;
+    }
+
+    template <typename Fn> void for_each(Fn &&fn) const {
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            if (keys[i] != empty) {
+                fn(keys[i], counts[i]);
+            }
+        }
+    }
+
+    std::size_t total() const {
+        std::size_t total = 0;
+        for_each([&total](IntType, std::size_t count) { total += count; });
+        return total;
+    }
+
+  private:
+    // Stones are never negative
+    static constexpr IntType empty = -1;
+
+    std::vector<IntType> keys;
+    std::vector<std::size_t> counts;
+    std::size_t num_keys = 0;
+
+    // Slot of the stone, claiming an empty one if it is not in the table yet
+    std::size_t find_slot(IntType stone) {
+        const auto mask = keys.size() - 1;
+        // Fibonacci hashing spreads consecutive values over the table
+        auto i = static_cast<std::size_t>((static_cast<std::uint64_t>(stone) *
+                                           0x9e3779b97f4a7c15ull) >>
+                                          (64 - std::countr_zero(keys.size())));
+        while (keys[i] != stone) {
+            if (keys[i] == empty) {
+                keys[i] = stone;
+                ++num_keys;
+                break;
+            }
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    void grow() {
+        stone_counts larger(keys.size());
+        for_each([&larger](IntType stone, std::size_t count) { larger.add(stone, count); });
+        *this = std::move(larger);
+    }
+};
+
+// Advances a stone -> count table one blink at a time, swapping between two tables. Returns the
+// number of stones after 0, 1, ..., num_blinks blinks.
+std::vector<std::size_t> count_stones(const std::vector<IntType> &stones, std::size_t num_blinks) {
+    stone_counts current;
+    stone_counts next;
+    for (const auto stone : stones) {
+        if (stone < 0) {
+            throw std::invalid_argument("Stones must not be negative");
+        }
+        current.add(stone, 1);
+    }
+
+    std::vector<std::size_t> totals;
+    totals.reserve(num_blinks + 1);
+    totals.push_back(current.total());
+    for (std::size_t num_blink = 0; num_blink < num_blinks; ++num_blink) {
+        next.clear();
+        current.for_each([&next](IntType stone, std::size_t count) {
+            const auto result = blink(stone);
+            if (const auto ptr = std::get_if<IntType>(&result)) {
+                next.add(*ptr, count);
+            } else if (const auto ptr = std::get_if<std::pair<IntType, IntType>>(&result)) {
+                next.add(ptr->first, count);
+                next.add(ptr->second, count);
+            }
+        });
+        std::swap(current, next);
+        totals.push_back(current.total());
+    }
+    return totals;
+}
+
+// Stone values reachable from the input under blink. Every state has one or two successors.
+struct transition_graph {
+    static constexpr std::uint32_t none = std::numeric_limits<std::uint32_t>::max();
+
     std::vector<IntType> stones;
-    stones.reserve(2 * std::distance(begin, end));
+    std::vector<std::array<std::uint32_t, 2>> successors;
+    std::vector<std::uint32_t> initial; // State of every input stone
+};
+
+transition_graph build_transition_graph(const std::vector<IntType> &input,
+                                        std::size_t max_states = 1 << 20) {
+    transition_graph graph;
+    std::unordered_map<IntType, std::uint32_t> states;
+    auto state_of = [&](IntType stone) {
+        const auto [it, inserted] =
+            states.try_emplace(stone, static_cast<std::uint32_t>(graph.stones.size()));
+        if (inserted) {
+            if (graph.stones.size() >= max_states) {
+                throw std::runtime_error("Too many distinct stones");
+            }
+            graph.stones.push_back(stone);
+        }
+        return it->second;
+    };
 
-    for (auto it = begin; it != end; ++it) {
-        auto result = blink(*it);
+    for (const auto stone : input) {
+        if (stone < 0) {
+            throw std::invalid_argument("Stones must not be negative");
+        }
+        graph.initial.push_back(state_of(stone));
+    }
+
+    // Breadth first, new states are appended while iterating
+    for (std::size_t state = 0; state < graph.stones.size(); ++state) {
+        const auto stone = graph.stones[state];
+        if (stone > std::numeric_limits<IntType>::max() / 2024) {
+            throw std::overflow_error("Stone does not fit into 64 bits after blinking");
+        }
+
+        std::array<std::uint32_t, 2> next = {transition_graph::none, transition_graph::none};
+        const auto result = blink(stone);
         if (const auto ptr = std::get_if<IntType>(&result)) {
-            stones.push_back(*ptr);
+            next[0] = state_of(*ptr);
         } else if (const auto ptr = std::get_if<std::pair<IntType, IntType>>(&result)) {
-            stones.push_back(ptr->first);
-            stones.push_back(ptr->second);
+            next[0] = state_of(ptr->first);
+            next[1] = state_of(ptr->second);
         }
+        graph.successors.push_back(next);
     }
-    return stones;
+    return graph;
 }
 
-std::size_t count_stones(IntType stone, std::size_t depth, std::size_t depth_limit,
-                         std::map<std::pair<IntType, std::size_t>, std::size_t> &mem) {
-    // Memoized?
-    const auto key = std::make_pair(stone, depth);
-    if (const auto it = mem.find(key); it != mem.cend()) {
-        return it->second;
+using ModInt = std::uint64_t;
+
+// a + b and a - b for a, b < mod, without overflowing for moduli close to 2^64
+ModInt add_mod(ModInt a, ModInt b, ModInt mod) { return a >= mod - b ? a - (mod - b) : a + b; }
+
+ModInt sub_mod(ModInt a, ModInt b, ModInt mod) { return a >= b ? a - b : a + (mod - b); }
+
+ModInt mul_mod(ModInt a, ModInt b, ModInt mod) {
+    if (mod <= std::numeric_limits<std::uint32_t>::max()) {
+        return a * b % mod;
     }
+    return static_cast<ModInt>(static_cast<unsigned __int128>(a) * b % mod);
+}
 
-    // Calculate result
-    std::size_t num_stones;
-    if (depth >= depth_limit) {
-        num_stones = 1;
+ModInt pow_mod(ModInt base, std::uint64_t exp, ModInt mod) {
+    ModInt result = 1 % mod;
+    for (base %= mod; exp > 0; exp >>= 1) {
+        if (exp & 1) {
+            result = mul_mod(result, base, mod);
+        }
+        base = mul_mod(base, base, mod);
+    }
+    return result;
+}
+
+// Deterministic Miller-Rabin for 64-bit numbers
+bool is_prime(std::uint64_t n) {
+    if (n < 2) {
+        return false;
+    }
+    constexpr std::array<std::uint64_t, 12> bases = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+    for (const auto p : bases) {
+        if (n % p == 0) {
+            return n == p;
+        }
+    }
+
+    const auto odd = (n - 1) >> std::countr_zero(n - 1);
+    for (const auto a : bases) {
+        auto x = pow_mod(a, odd, n);
+        if (x == 1 || x == n - 1) {
+            continue;
+        }
+        auto composite = true;
+        for (auto d = odd; d != n - 1 && composite; d <<= 1) {
+            x = mul_mod(x, x, n);
+            composite = x != n - 1;
+        }
+        if (composite) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Sum of products modulo `mod` that accumulates in 128 bits and only reduces when the next
+// product could overflow
+class mod_accumulator {
+  public:
+    explicit mod_accumulator(ModInt mod) : mod(mod) {
+        const auto max_product = static_cast<unsigned __int128>(mod - 1) * (mod - 1);
+        const auto limit = max_product == 0 ? ~std::size_t{0}
+                                            : (~static_cast<unsigned __int128>(0) - mod) /
+                                                  max_product;
+        max_pending = static_cast<std::size_t>(
+            std::min<unsigned __int128>(limit, std::numeric_limits<std::size_t>::max()));
+    }
+
+    void reset(ModInt value = 0) {
+        acc = value;
+        pending = 0;
+    }
+
+    void add(ModInt a, ModInt b) {
+        acc += static_cast<unsigned __int128>(a) * b;
+        if (++pending == max_pending) {
+            acc %= mod;
+            pending = 0;
+        }
+    }
+
+    ModInt value() const { return static_cast<ModInt>(acc % mod); }
+
+  private:
+    ModInt mod;
+    std::size_t max_pending;
+    unsigned __int128 acc = 0;
+    std::size_t pending = 0;
+};
+
+// Number of stones modulo `mod` after 0, 1, ..., num_terms - 1 blinks
+std::vector<ModInt> count_stones_mod(const transition_graph &graph, std::size_t num_terms,
+                                     ModInt mod) {
+    std::vector<ModInt> current(graph.stones.size());
+    std::vector<ModInt> next(graph.stones.size());
+    for (const auto state : graph.initial) {
+        current[state] = add_mod(current[state], 1 % mod, mod);
+    }
+
+    std::vector<ModInt> terms;
+    terms.reserve(num_terms);
+    while (terms.size() < num_terms) {
+        ModInt total = 0;
+        for (const auto count : current) {
+            total = add_mod(total, count, mod);
+        }
+        terms.push_back(total);
+
+        std::fill(next.begin(), next.end(), 0);
+        for (std::size_t state = 0; state < current.size(); ++state) {
+            for (const auto successor : graph.successors[state]) {
+                if (successor != transition_graph::none) {
+                    next[successor] = add_mod(next[successor], current[state], mod);
+                }
+            }
+        }
+        std::swap(current, next);
+    }
+    return terms;
+}
+
+// Shortest linear recurrence terms[n] = sum_i coefficients[i] * terms[n - 1 - i] modulo a prime
+// (Berlekamp-Massey)
+std::vector<ModInt> find_recurrence(const std::vector<ModInt> &terms, ModInt mod) {
+    std::vector<ModInt> current = {1};
+    std::vector<ModInt> previous = {1};
+    std::size_t length = 0;
+    std::size_t shift = 1;
+    ModInt previous_discrepancy = 1;
+    mod_accumulator acc(mod);
+
+    for (std::size_t n = 0; n < terms.size(); ++n) {
+        acc.reset(terms[n]);
+        for (std::size_t i = 1; i <= length; ++i) {
+            acc.add(current[i], terms[n - i]);
+        }
+        const auto discrepancy = acc.value();
+        if (discrepancy == 0) {
+            ++shift;
+            continue;
+        }
+
+        const auto factor =
+            mul_mod(discrepancy, pow_mod(previous_discrepancy, mod - 2, mod), mod);
+        auto updated = current;
+        updated.resize(std::max(current.size(), previous.size() + shift), 0);
+        for (std::size_t i = 0; i < previous.size(); ++i) {
+            const auto term = mul_mod(factor, previous[i], mod);
+            updated[i + shift] = sub_mod(updated[i + shift], term, mod);
+        }
+
+        if (2 * length <= n) {
+            previous = std::move(current);
+            previous_discrepancy = discrepancy;
+            length = n + 1 - length;
+            shift = 1;
+        } else {
+            ++shift;
+        }
+        current = std::move(updated);
+    }
+
+    std::vector<ModInt> coefficients(length);
+    for (std::size_t i = 0; i < length; ++i) {
+        coefficients[i] = (mod - current[i + 1]) % mod;
+    }
+    return coefficients;
+}
+
+// Term n of a linear recurrence: x^n is reduced modulo the characteristic polynomial by repeated
+// squaring, so that terms[n] = sum_i (x^n mod C)_i * terms[i] (Kitamasa)
+ModInt nth_term(const std::vector<ModInt> &terms, const std::vector<ModInt> &coefficients,
+                std::uint64_t n, ModInt mod) {
+    if (n < terms.size()) {
+        return terms[n];
+    }
+    const auto length = coefficients.size();
+    if (length == 0) {
+        return 0;
+    }
+
+    mod_accumulator acc(mod);
+    std::vector<ModInt> high(length);
+    // Product of two polynomials of degree < length modulo the characteristic polynomial. The
+    // coefficients of x^k for k >= length are folded back via x^k = sum_i c_i x^(k - 1 - i).
+    auto mul = [&](const std::vector<ModInt> &a, const std::vector<ModInt> &b) {
+        const auto size = 2 * length - 1;
+        std::vector<ModInt> product(length);
+        for (auto k = size; k-- > 0;) {
+            acc.reset();
+            for (auto i = k < length ? 0 : k - length + 1; i <= std::min(k, length - 1); ++i) {
+                acc.add(a[i], b[k - i]);
+            }
+            for (auto i = length > k ? length - k : 1; i <= length && k + i < size; ++i) {
+                acc.add(high[k + i - length], coefficients[i - 1]);
+            }
+            (k >= length ? high[k - length] : product[k]) = acc.value();
+        }
+        return product;
+    };
+
+    std::vector<ModInt> result(length);
+    result[0] = 1 % mod;
+    std::vector<ModInt> base(length);
+    if (length == 1) {
+        base[0] = coefficients[0];
     } else {
-        const auto result = blink(stone);
-        if (const auto result_ptr = std::get_if<IntType>(&result)) {
-            num_stones = count_stones(*result_ptr, depth + 1, depth_limit, mem);
+        base[1] = 1;
+    }
+    for (; n > 0; n >>= 1) {
+        if (n & 1) {
+            result = mul(result, base);
         }
-        if (const auto result_ptr = std::get_if<std::pair<IntType, IntType>>(&result)) {
-            num_stones = count_stones(result_ptr->first, depth + 1, depth_limit, mem) +
-                         count_stones(result_ptr->second, depth + 1, depth_limit, mem);
+        if (n > 1) {
+            base = mul(base, base);
         }
     }
 
-    // Memoize!
-    mem[key] = num_stones;
-    return num_stones;
+    acc.reset();
+    for (std::size_t i = 0; i < length; ++i) {
+        acc.add(result[i], terms[i]);
+    }
+    return acc.value();
 }
 
-int main() {
-    const auto input = read_input(std::cin);
+// Number of stones after num_blinks blinks modulo a prime. The counts follow a linear recurrence
+// whose order is at most the number of reachable stone values, so twice that many terms
+// determine it.
+ModInt count_stones_mod(const std::vector<IntType> &input, std::uint64_t num_blinks, ModInt mod) {
+    if (!is_prime(mod)) {
+        throw std::invalid_argument("Modulus must be prime");
+    }
+    const auto graph = build_transition_graph(input);
+    const auto terms = count_stones_mod(graph, 2 * graph.stones.size() + 1, mod);
+    const auto coefficients = find_recurrence(terms, mod);
+    return nth_term(terms, coefficients, num_blinks, mod);
+}
 
-    std::vector<IntType> stones(input.cbegin(), input.cend());
-    for (std::size_t num_blink = 0; num_blink < 25; ++num_blink) {
-        stones = blink(stones.cbegin(), stones.cend());
+int main(int argc, char *argv[]) {
+    // --blinks N --mod P counts the stones after N blinks modulo the prime P
+    std::optional<std::uint64_t> num_blinks;
+    std::optional<ModInt> mod;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string_view option = argv[i];
+        if (option == "--blinks") {
+            num_blinks = std::stoull(argv[i + 1]);
+        } else if (option == "--mod") {
+            mod = std::stoull(argv[i + 1]);
+        } else {
+            throw std::invalid_argument("Unknown option");
+        }
+    }
+    if (argc % 2 == 0 || num_blinks.has_value() != mod.has_value()) {
+        throw std::invalid_argument("Usage: day11 [--blinks N --mod P]");
     }
-    std::cout << "Part 1: " << stones.size() << "\n";
 
-    std::size_t total = 0;
-    std::map<std::pair<IntType, std::size_t>, std::size_t> mem;
-    for (const auto stone : input) {
-        total += count_stones(stone, 0, 75, mem);
+    const auto input = read_input(std::cin);
+
+    if (num_blinks) {
+        std::cout << "Stones after " << *num_blinks
+                  << " blinks: " << count_stones_mod(input, *num_blinks, *mod) << " (mod "
+                  << *mod << ")\n";
+        return 0;
     }
-    std::cout << "Part 2: " << total << "\n";
+
+    const auto totals = count_stones(input, 75);
+
+    std::cout << "Part 1: " << totals[25] << "\n";
+    std::cout << "Part 2: " << totals[75] << "\n";
 
     return 0;
 }
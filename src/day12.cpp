@@ -1,191 +1,259 @@
 #include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include <print>
-#include <set>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
-using garden_plot = std::vector<std::vector<char>>;
+struct garden_map {
+    int num_rows = 0;
+    int num_cols = 0;
+    std::vector<char> plants;
 
-garden_plot read_input(std::istream &istream) {
-    garden_plot gp;
+    // Plant at (row, col), or '\0' outside of the map
+    char at(int row, int col) const {
+        if (row < 0 || row >= num_rows || col < 0 || col >= num_cols) {
+            return '\0';
+        }
+        return plants[static_cast<std::size_t>(row) * num_cols + col];
+    }
+};
+
+garden_map read_input(std::istream &istream) {
+    garden_map map;
     std::string line;
     while (std::getline(istream, line)) {
-        gp.emplace_back(line.cbegin(), line.cend());
+        if (map.num_rows == 0) {
+            map.num_cols = static_cast<int>(line.size());
+        } else if (static_cast<int>(line.size()) != map.num_cols) {
+            throw std::runtime_error("Invalid input: rows of different length");
+        }
+        map.plants.insert(map.plants.end(), line.cbegin(), line.cend());
+        ++map.num_rows;
     }
-    return gp;
+    return map;
 }
 
-struct tile {
-    char value;
-    std::size_t row;
-    std::size_t col;
+struct region_stats {
+    std::size_t area = 0;
+    std::size_t perimeter = 0;
+    std::size_t corners = 0; // A region has as many sides as corners
+};
 
-    bool has_north = false;
-    bool has_east = false;
-    bool has_south = false;
-    bool has_west = false;
+// Provisional region labels joined with union-find. The statistics of a label only cover its own
+// cells until they are summed into the roots.
+struct region_labels {
+    std::vector<std::uint32_t> parent;
+    std::vector<region_stats> stats;
+
+    std::uint32_t add() {
+        const auto label = static_cast<std::uint32_t>(parent.size());
+        parent.push_back(label);
+        stats.emplace_back();
+        return label;
+    }
 
-    bool operator<(const tile &other) const {
-        return std::tie(this->row, this->col) < std::tie(other.row, other.col);
+    std::uint32_t find(std::uint32_t label) {
+        while (parent[label] != label) {
+            parent[label] = parent[parent[label]];
+            label = parent[label];
+        }
+        return label;
     }
-};
 
-std::vector<tile> get_region(std::size_t start_row, std::size_t start_col,
-                             const garden_plot &plot) {
-    const auto num_rows = plot.size();
-    const auto num_cols = plot[0].size();
-    const auto tile_value = plot[start_row][start_col];
+    // The smaller label becomes the root
+    void unite(std::uint32_t a, std::uint32_t b) {
+        a = find(a);
+        b = find(b);
+        if (a < b) {
+            parent[b] = a;
+        } else if (b < a) {
+            parent[a] = b;
+        }
+    }
+};
 
-    std::vector<tile> region;
-    std::set<tile> visited;
+// Adds the fence of the cell at (row, col) to `stats`. The perimeter counts the neighbors with a
+// different plant, the corners are found in the 2x2 neighborhoods around the cell: two differing
+// edge neighbors make an outer corner, two matching ones with a differing diagonal an inner one.
+void add_cell(const garden_map &map, int row, int col, region_stats &stats) {
+    const auto plant = map.at(row, col);
+    const bool north = map.at(row - 1, col) == plant;
+    const bool east = map.at(row, col + 1) == plant;
+    const bool south = map.at(row + 1, col) == plant;
+    const bool west = map.at(row, col - 1) == plant;
+
+    auto is_corner = [&](bool a, bool b, int diagonal_row, int diagonal_col) {
+        return (!a && !b) || (a && b && map.at(diagonal_row, diagonal_col) != plant);
+    };
+
+    ++stats.area;
+    stats.perimeter += 4 - (north + east + south + west);
+    stats.corners += is_corner(north, east, row - 1, col + 1) +
+                     is_corner(east, south, row + 1, col + 1) +
+                     is_corner(south, west, row + 1, col - 1) +
+                     is_corner(west, north, row - 1, col - 1);
+}
 
-    std::vector<tile> stack;
-    stack.emplace_back(tile{.value = tile_value, .row = start_row, .col = start_col});
+// One raster pass over rows [row_begin, row_end): every cell takes the label of its north or west
+// neighbor when it has the same plant (uniting both if they differ) and a new label otherwise.
+// Only the labels of the previous row are kept. Neighbors outside the rows still count for the
+// fence, but are not joined.
+void label_rows(const garden_map &map, int row_begin, int row_end, region_labels &labels,
+                std::vector<std::uint32_t> &first_row, std::vector<std::uint32_t> &last_row) {
+    std::vector<std::uint32_t> previous(map.num_cols);
+    std::vector<std::uint32_t> current(map.num_cols);
+
+    for (auto row = row_begin; row < row_end; ++row) {
+        for (int col = 0; col < map.num_cols; ++col) {
+            const auto plant = map.at(row, col);
+            const auto same_north = row > row_begin && map.at(row - 1, col) == plant;
+            const auto same_west = col > 0 && map.at(row, col - 1) == plant;
+
+            std::uint32_t label;
+            if (same_north) {
+                label = previous[col];
+                if (same_west) {
+                    labels.unite(label, current[col - 1]);
+                }
+            } else if (same_west) {
+                label = current[col - 1];
+            } else {
+                label = labels.add();
+            }
 
-    while (!stack.empty()) {
-        auto t = stack.back();
-        stack.pop_back();
-        if (visited.contains(t)) {
-            continue;
+            current[col] = label;
+            add_cell(map, row, col, labels.stats[label]);
         }
 
-        // North
-        if (t.row >= 1 && plot[t.row - 1][t.col] == tile_value) {
-            stack.emplace_back(
-                tile{.value = plot[t.row - 1][t.col], .row = t.row - 1, .col = t.col});
-            t.has_north = true;
-        }
-        // East
-        if (t.col + 1 < num_cols && plot[t.row][t.col + 1] == tile_value) {
-            stack.emplace_back(
-                tile{.value = plot[t.row][t.col + 1], .row = t.row, .col = t.col + 1});
-            t.has_east = true;
+        if (row == row_begin) {
+            first_row = current;
         }
-        // South
-        if (t.row + 1 < num_rows && plot[t.row + 1][t.col] == tile_value) {
-            stack.emplace_back(
-                tile{.value = plot[t.row + 1][t.col], .row = t.row + 1, .col = t.col});
-            t.has_south = true;
-        }
-        // West
-        if (t.col >= 1 && plot[t.row][t.col - 1] == tile_value) {
-            stack.emplace_back(
-                tile{.value = plot[t.row][t.col - 1], .row = t.row, .col = t.col - 1});
-            t.has_west = true;
-        }
-
-        region.push_back(t);
-        visited.insert(t);
+        std::swap(previous, current);
     }
-
-    return region;
+    last_row = std::move(previous);
 }
 
-std::vector<std::vector<tile>> get_all_regions(const garden_plot &plot) {
-    const auto num_rows = plot.size();
-    const auto num_cols = plot[0].size();
-
-    std::set<std::pair<std::size_t, std::size_t>> visited;
-    std::vector<std::vector<tile>> regions;
-
-    for (std::size_t row = 0; row < num_rows; ++row) {
-        for (std::size_t col = 0; col < num_cols; ++col) {
-            if (visited.contains({row, col})) {
-                continue;
-            }
+struct fence_totals {
+    std::size_t price = 0;
+    std::size_t discounted_price = 0;
+};
 
-            const auto region = get_region(row, col, plot);
-            for (const auto &t : region) {
-                visited.insert({t.row, t.col});
-            }
-            regions.emplace_back(std::move(region));
+// Sums the statistics of all labels into their roots and prices the regions
+fence_totals price_regions(region_labels &labels) {
+    const auto num_labels = static_cast<std::uint32_t>(labels.parent.size());
+    for (std::uint32_t label = 0; label < num_labels; ++label) {
+        const auto root = labels.find(label);
+        if (root != label) {
+            auto &sum = labels.stats[root];
+            const auto &stats = labels.stats[label];
+            sum.area += stats.area;
+            sum.perimeter += stats.perimeter;
+            sum.corners += stats.corners;
         }
     }
 
-    return regions;
+    fence_totals totals;
+    for (std::uint32_t label = 0; label < num_labels; ++label) {
+        if (labels.parent[label] == label) {
+            const auto &stats = labels.stats[label];
+            totals.price += stats.area * stats.perimeter;
+            totals.discounted_price += stats.area * stats.corners;
+        }
+    }
+    return totals;
 }
 
-std::size_t get_perimeter(const std::vector<tile> &region) {
-    std::size_t total = 0;
-    for (const auto &t : region) {
-        total += !t.has_north + !t.has_east + !t.has_south + !t.has_west;
-    }
-    return total;
+fence_totals price_regions(const garden_map &map) {
+    region_labels labels;
+    std::vector<std::uint32_t> first_row;
+    std::vector<std::uint32_t> last_row;
+    label_rows(map, 0, map.num_rows, labels, first_row, last_row);
+    return price_regions(labels);
 }
 
-std::size_t get_north_or_south_sides(std::vector<tile> edges) {
-    std::sort(edges.begin(), edges.end(), [](const tile &lhs, const tile &rhs) {
-        return std::tie(lhs.row, lhs.col) < std::tie(rhs.row, rhs.col);
-    });
-
-    std::size_t sides = 1;
-    if (edges.size() > 1) {
-        for (auto it1 = edges.cbegin(), it2 = edges.cbegin() + 1; it2 != edges.cend();
-             ++it1, ++it2) {
-            if (it1->row != it2->row || it2->col - it1->col > 1) {
-                ++sides;
-            }
+// Parallel mode for large maps: every thread labels a horizontal stripe and sums the statistics
+// into its local roots, which are then numbered consecutively. The merge step only joins the roots
+// of matching cells across the stripe boundaries.
+fence_totals price_regions_parallel(const garden_map &map) {
+    if (map.num_rows == 0) {
+        return {};
+    }
+    const auto num_stripes = std::max<std::size_t>(
+        1, std::min<std::size_t>(std::thread::hardware_concurrency(), map.num_rows));
+
+    struct stripe {
+        region_labels roots;
+        std::vector<std::uint32_t> first_row;
+        std::vector<std::uint32_t> last_row;
+    };
+    std::vector<stripe> stripes(num_stripes);
+    auto row_begin = [&](std::size_t s) {
+        return static_cast<int>(s * map.num_rows / num_stripes);
+    };
+
+    {
+        std::vector<std::jthread> workers;
+        for (std::size_t s = 0; s < num_stripes; ++s) {
+            workers.emplace_back([&, s]() {
+                auto &[roots, first_row, last_row] = stripes[s];
+                region_labels labels;
+                label_rows(map, row_begin(s), row_begin(s + 1), labels, first_row, last_row);
+
+                // Root labels in increasing order become 0, 1, ...
+                const auto num_labels = static_cast<std::uint32_t>(labels.parent.size());
+                std::vector<std::uint32_t> root_index(num_labels);
+                for (std::uint32_t label = 0; label < num_labels; ++label) {
+                    const auto root = labels.find(label);
+                    if (root == label) {
+                        root_index[label] = roots.add();
+                        roots.stats.back() = labels.stats[label];
+                    } else {
+                        auto &sum = roots.stats[root_index[root]];
+                        sum.area += labels.stats[label].area;
+                        sum.perimeter += labels.stats[label].perimeter;
+                        sum.corners += labels.stats[label].corners;
+                    }
+                }
+                for (auto *row : {&first_row, &last_row}) {
+                    for (auto &label : *row) {
+                        label = root_index[labels.find(label)];
+                    }
+                }
+            });
         }
     }
-    return sides;
-}
 
-std::size_t get_east_or_west_sides(std::vector<tile> edges) {
-    std::sort(edges.begin(), edges.end(), [](const tile &lhs, const tile &rhs) {
-        return std::tie(lhs.col, lhs.row) < std::tie(rhs.col, rhs.row);
-    });
-
-    std::size_t sides = 1;
-    if (edges.size() > 1) {
-        for (auto it1 = edges.cbegin(), it2 = edges.cbegin() + 1; it2 != edges.cend();
-             ++it1, ++it2) {
-            if (it1->col != it2->col || it2->row - it1->row > 1) {
-                ++sides;
+    region_labels merged;
+    std::vector<std::uint32_t> offsets(num_stripes);
+    for (std::size_t s = 0; s < num_stripes; ++s) {
+        offsets[s] = static_cast<std::uint32_t>(merged.parent.size());
+        for (const auto &stats : stripes[s].roots.stats) {
+            merged.stats[merged.add()] = stats;
+        }
+    }
+    for (std::size_t s = 1; s < num_stripes; ++s) {
+        const auto row = row_begin(s);
+        for (int col = 0; col < map.num_cols; ++col) {
+            if (map.at(row - 1, col) == map.at(row, col)) {
+                merged.unite(offsets[s - 1] + stripes[s - 1].last_row[col],
+                             offsets[s] + stripes[s].first_row[col]);
             }
         }
     }
-    return sides;
+    return price_regions(merged);
 }
 
-std::size_t get_sides(const std::vector<tile> &region) {
-    std::vector<tile> north_edges;
-    std::copy_if(region.cbegin(), region.cend(), std::back_inserter(north_edges),
-                 [](const auto &t) { return !t.has_north; });
-    const auto north_sides = get_north_or_south_sides(north_edges);
-
-    std::vector<tile> south_edges;
-    std::copy_if(region.cbegin(), region.cend(), std::back_inserter(south_edges),
-                 [](const auto &t) { return !t.has_south; });
-    const auto south_sides = get_north_or_south_sides(south_edges);
-
-    std::vector<tile> east_edges;
-    std::copy_if(region.cbegin(), region.cend(), std::back_inserter(east_edges),
-                 [](const auto &t) { return !t.has_east; });
-    const auto east_sides = get_east_or_west_sides(east_edges);
-
-    std::vector<tile> west_edges;
-    std::copy_if(region.cbegin(), region.cend(), std::back_inserter(west_edges),
-                 [](const auto &t) { return !t.has_west; });
-    const auto west_sides = get_east_or_west_sides(west_edges);
-
-    return north_sides + east_sides + south_sides + west_sides;
-}
+// From this many cells on the parallel mode is used
+constexpr std::size_t min_parallel_cells = std::size_t{1} << 20;
 
 int main() {
-    const auto plot = read_input(std::cin);
-    const auto regions = get_all_regions(plot);
-
-    std::size_t total_fence = 0;
-    std::size_t total_fence_discounted = 0;
-    for (const auto &region : regions) {
-        const auto area = region.size();
-        const auto perimeter = get_perimeter(region);
-        const auto sides = get_sides(region);
-
-        total_fence += area * perimeter;
-        total_fence_discounted += area * sides;
-    }
+    const auto map = read_input(std::cin);
+    const auto [total_fence, total_fence_discounted] = map.plants.size() >= min_parallel_cells
+                                                           ? price_regions_parallel(map)
+                                                           : price_regions(map);
 
     std::println("Part 1: {}", total_fence);
     std::println("Part 2: {}", total_fence_discounted);
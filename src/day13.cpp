@@ -1,7 +1,17 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <numeric>
+#include <optional>
 #include <print>
 #include <regex>
 #include <sstream>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 struct vec2u {
     std::size_t x;
@@ -40,54 +50,227 @@ std::vector<game> read_input(std::istream &istream) {
     return games;
 }
 
-long det(long a, long b, long c, long d) { return a * d - b * c; }
+// Games as structure of arrays
+struct game_columns {
+    std::vector<std::int64_t> a_x;
+    std::vector<std::int64_t> a_y;
+    std::vector<std::int64_t> b_x;
+    std::vector<std::int64_t> b_y;
+    std::vector<std::int64_t> prize_x;
+    std::vector<std::int64_t> prize_y;
 
-std::optional<std::size_t> solve_game_min_cost(const game &g) {
-    const auto D = det(g.button_a.x, g.button_b.x, g.button_a.y, g.button_b.y);
-    if (D == 0) {
-        // No solution
+    std::size_t size() const { return a_x.size(); }
+};
+
+game_columns to_columns(const std::vector<game> &games) {
+    constexpr auto max_value = static_cast<std::size_t>(std::numeric_limits<std::int64_t>::max());
+
+    game_columns columns;
+    for (const auto &g : games) {
+        for (const auto value : {g.button_a.x, g.button_a.y, g.button_b.x, g.button_b.y,
+                                 g.prize.x, g.prize.y}) {
+            if (value > max_value) {
+                throw std::out_of_range("Game does not fit into 64 bits");
+            }
+        }
+        columns.a_x.push_back(static_cast<std::int64_t>(g.button_a.x));
+        columns.a_y.push_back(static_cast<std::int64_t>(g.button_a.y));
+        columns.b_x.push_back(static_cast<std::int64_t>(g.button_b.x));
+        columns.b_y.push_back(static_cast<std::int64_t>(g.button_b.y));
+        columns.prize_x.push_back(static_cast<std::int64_t>(g.prize.x));
+        columns.prize_y.push_back(static_cast<std::int64_t>(g.prize.y));
+    }
+    return columns;
+}
+
+std::optional<std::size_t> to_cost(__int128 a, __int128 b) {
+    if (a < 0 || b < 0) {
+        return {};
+    }
+    const auto cost = 3 * a + b;
+    if (cost > std::numeric_limits<std::size_t>::max()) {
+        throw std::overflow_error("Cost does not fit into 64 bits");
+    }
+    return static_cast<std::size_t>(cost);
+}
+
+// Returns (g, x, y) with a * x + b * y = g = gcd(a, b) for a, b >= 0
+std::tuple<__int128, __int128, __int128> extended_gcd(__int128 a, __int128 b) {
+    __int128 x = 1;
+    __int128 y = 0;
+    __int128 next_x = 0;
+    __int128 next_y = 1;
+    while (b != 0) {
+        const auto q = a / b;
+        a = std::exchange(b, a - q * b);
+        x = std::exchange(next_x, x - q * next_x);
+        y = std::exchange(next_y, y - q * next_y);
+    }
+    return {a, x, y};
+}
+
+// Smallest t >= 0 with factor * t = target (mod modulus), given gcd(factor, modulus) = 1 and the
+// coefficient of factor from the extended gcd
+__int128 smallest_solution(__int128 coefficient, __int128 target, __int128 modulus) {
+    const auto t = (coefficient % modulus) * (target % modulus) % modulus;
+    return t < 0 ? t + modulus : t;
+}
+
+// Games with D = 0: both buttons are multiples alpha * u and beta * u of a primitive direction u,
+// so the prize has to be gamma * u and alpha * a + beta * b = gamma. The solutions are
+// a = a_min + t * beta / g, b = b_max - t * alpha / g with g = gcd(alpha, beta), and the cost
+// changes by (3 * beta - alpha) / g per step: the cheapest solution has the fewest presses of A
+// if 3 * beta >= alpha and the fewest presses of B otherwise.
+std::optional<std::size_t> solve_collinear_game(std::int64_t a_x, std::int64_t a_y,
+                                                std::int64_t b_x, std::int64_t b_y,
+                                                __int128 prize_x, __int128 prize_y) {
+    const auto alpha = std::gcd(a_x, a_y);
+    const auto beta = std::gcd(b_x, b_y);
+    if (alpha == 0 && beta == 0) {
+        return prize_x == 0 && prize_y == 0 ? to_cost(0, 0) : std::nullopt;
+    }
+
+    const auto u_x = alpha != 0 ? a_x / alpha : b_x / beta;
+    const auto u_y = alpha != 0 ? a_y / alpha : b_y / beta;
+    const auto gamma = u_x != 0 ? prize_x / u_x : prize_y / u_y;
+    if (gamma < 0 || prize_x != gamma * u_x || prize_y != gamma * u_y) {
         return {};
     }
 
-    const auto D_a = det(g.prize.x, g.button_b.x, g.prize.y, g.button_b.y);
-    if (D_a % D != 0) {
-        // No integer solution
+    if (alpha == 0 || beta == 0) {
+        // Only one button moves the claw
+        const auto step = alpha != 0 ? alpha : beta;
+        if (gamma % step != 0) {
+            return {};
+        }
+        return alpha != 0 ? to_cost(gamma / step, 0) : to_cost(0, gamma / step);
+    }
+
+    const auto [g, x, y] = extended_gcd(alpha, beta);
+    if (gamma % g != 0) {
         return {};
     }
+    const auto alpha_g = alpha / g;
+    const auto beta_g = beta / g;
+    const auto gamma_g = gamma / g;
 
-    const auto D_b = det(g.button_a.x, g.prize.x, g.button_a.y, g.prize.y);
-    if (D_b % D != 0) {
-        // No integer solution
+    // alpha_g * x = 1 (mod beta_g) and beta_g * y = 1 (mod alpha_g)
+    const auto a_min = smallest_solution(x, gamma_g, beta_g);
+    if (a_min * alpha > gamma) {
         return {};
     }
+    if (3 * static_cast<__int128>(beta) >= alpha) {
+        return to_cost(a_min, (gamma - a_min * alpha) / beta);
+    }
+    const auto b_min = smallest_solution(y, gamma_g, alpha_g);
+    return to_cost((gamma - b_min * beta) / alpha, b_min);
+}
 
-    const auto a = D_a / D;
-    const auto b = D_b / D;
-    return 3 * a + b;
+// Cramer's rule for a * button_a + b * button_b = prize, exact in 128 bits for any 64-bit game
+// and offset
+std::optional<std::size_t> solve_game_wide(std::int64_t a_x, std::int64_t a_y, std::int64_t b_x,
+                                           std::int64_t b_y, __int128 prize_x, __int128 prize_y) {
+    const __int128 D = static_cast<__int128>(a_x) * b_y - static_cast<__int128>(b_x) * a_y;
+    if (D == 0) {
+        return solve_collinear_game(a_x, a_y, b_x, b_y, prize_x, prize_y);
+    }
+
+    const auto D_a = prize_x * b_y - prize_y * b_x;
+    const auto D_b = prize_y * a_x - prize_x * a_y;
+    if (D_a % D != 0 || D_b % D != 0) {
+        return {};
+    }
+    return to_cost(D_a / D, D_b / D);
 }
 
-int main() {
-    const auto games = read_input(std::cin);
+// Minimum cost to win all winnable games, for every prize offset. The games are processed in
+// blocks and each block is solved for all offsets, so the determinants D are shared. Where the
+// sub-determinants stay below 2^53 they are computed in 64 bits and the quotients in double, which
+// is exact for integer quotients: a branch-free loop the compiler can vectorize. Other offsets fall
+// back to __int128.
+std::vector<std::size_t> solve_games_min_cost(const game_columns &games,
+                                              const std::vector<std::int64_t> &offsets) {
+    constexpr std::size_t block_size = 1024;
+    constexpr __int128 max_exact = __int128{1} << 53;
 
-    std::size_t total_pt1 = 0;
-    std::size_t total_pt2 = 0;
-    for (const auto &g : games) {
-        const auto min_cost = solve_game_min_cost(g);
-        if (min_cost) {
-            total_pt1 += *min_cost;
+    std::int64_t max_button = 0;
+    std::int64_t max_prize = 0;
+    for (std::size_t i = 0; i < games.size(); ++i) {
+        max_button = std::max({max_button, games.a_x[i], games.a_y[i], games.b_x[i], games.b_y[i]});
+        max_prize = std::max({max_prize, games.prize_x[i], games.prize_y[i]});
+    }
+
+    // |D| <= 2 * max_button^2 and |D_a|, |D_b| <= 2 * max_button * max |prize + offset|
+    std::vector<bool> narrow(offsets.size());
+    for (std::size_t k = 0; k < offsets.size(); ++k) {
+        const auto largest = std::max<__int128>({static_cast<__int128>(max_prize) + offsets[k],
+                                                 -static_cast<__int128>(offsets[k]), max_button});
+        narrow[k] = 2 * static_cast<__int128>(max_button) * largest < max_exact;
+    }
+    const auto any_narrow = std::find(narrow.cbegin(), narrow.cend(), true) != narrow.cend();
+
+    std::vector<std::size_t> totals(offsets.size());
+    std::array<std::int64_t, block_size> D;
+    std::array<std::size_t, block_size> collinear;
+    for (std::size_t begin = 0; begin < games.size(); begin += block_size) {
+        const auto end = std::min(games.size(), begin + block_size);
+
+        // Collinear games are rare and solved separately after the vectorized loop
+        std::size_t num_collinear = 0;
+        for (auto i = begin; any_narrow && i < end; ++i) {
+            D[i - begin] = games.a_x[i] * games.b_y[i] - games.b_x[i] * games.a_y[i];
+            if (D[i - begin] == 0) {
+                collinear[num_collinear++] = i;
+            }
         }
 
-        game game_pt2 = g;
-        game_pt2.prize.x += 10000000000000uz;
-        game_pt2.prize.y += 10000000000000uz;
-        const auto min_cost_pt2 = solve_game_min_cost(game_pt2);
-        if (min_cost_pt2) {
-            total_pt2 += *min_cost_pt2;
+        for (std::size_t k = 0; k < offsets.size(); ++k) {
+            std::size_t total = 0;
+            if (narrow[k]) {
+                const auto offset = offsets[k];
+                for (auto i = begin; i < end; ++i) {
+                    const auto d = D[i - begin];
+                    const auto prize_x = games.prize_x[i] + offset;
+                    const auto prize_y = games.prize_y[i] + offset;
+                    const auto D_a = prize_x * games.b_y[i] - prize_y * games.b_x[i];
+                    const auto D_b = prize_y * games.a_x[i] - prize_x * games.a_y[i];
+
+                    const auto divisor = static_cast<double>(d == 0 ? 1 : d);
+                    const auto a = static_cast<std::int64_t>(static_cast<double>(D_a) / divisor);
+                    const auto b = static_cast<std::int64_t>(static_cast<double>(D_b) / divisor);
+                    const auto solved =
+                        d != 0 && a * d == D_a && b * d == D_b && a >= 0 && b >= 0;
+                    total += solved ? static_cast<std::size_t>(3 * a + b) : 0;
+                }
+                for (std::size_t j = 0; j < num_collinear; ++j) {
+                    const auto i = collinear[j];
+                    const auto cost = solve_collinear_game(
+                        games.a_x[i], games.a_y[i], games.b_x[i], games.b_y[i],
+                        static_cast<__int128>(games.prize_x[i]) + offset,
+                        static_cast<__int128>(games.prize_y[i]) + offset);
+                    total += cost.value_or(0);
+                }
+            } else {
+                for (auto i = begin; i < end; ++i) {
+                    const auto cost = solve_game_wide(
+                        games.a_x[i], games.a_y[i], games.b_x[i], games.b_y[i],
+                        static_cast<__int128>(games.prize_x[i]) + offsets[k],
+                        static_cast<__int128>(games.prize_y[i]) + offsets[k]);
+                    total += cost.value_or(0);
+                }
+            }
+            totals[k] += total;
         }
     }
+    return totals;
+}
+
+int main() {
+    const auto games = to_columns(read_input(std::cin));
+    const auto totals = solve_games_min_cost(games, {0, 10000000000000});
 
-    std::println("Part 1: {}", total_pt1);
-    std::println("Part 2: {}", total_pt2);
+    std::println("Part 1: {}", totals[0]);
+    std::println("Part 2: {}", totals[1]);
 
     return 0;
 }
@@ -1,10 +1,17 @@
 #include <algorithm>
-#include <cmath>
+#include <array>
+#include <cstdint>
 #include <iostream>
-#include <map>
+#include <limits>
+#include <numeric>
+#include <optional>
 #include <print>
 #include <regex>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 struct robot_state {
     std::size_t px;
@@ -30,17 +37,128 @@ std::vector<robot_state> read_input(std::istream &istream) {
     return robots;
 }
 
-void print_robots(std::size_t width, std::size_t height, const std::vector<robot_state> robots) {
-    using coordinates = std::pair<std::size_t, std::size_t>;
-    std::map<coordinates, std::size_t> robot_counts;
+// Robots as structure of arrays on a board of any size up to 2^32 x 2^32. Velocities are
+// normalized to [0, size), so all arithmetic stays unsigned and fits into 64 bits.
+struct robot_columns {
+    std::uint64_t width = 0;
+    std::uint64_t height = 0;
+    std::vector<std::uint64_t> px;
+    std::vector<std::uint64_t> py;
+    std::vector<std::uint64_t> vx;
+    std::vector<std::uint64_t> vy;
+
+    std::size_t size() const { return px.size(); }
+};
+
+robot_columns to_columns(const std::vector<robot_state> &robots, std::uint64_t width,
+                         std::uint64_t height) {
+    constexpr std::uint64_t max_size = std::uint64_t{1} << 32;
+    if (width == 0 || height == 0 || width > max_size || height > max_size) {
+        throw std::invalid_argument("Board size must be in [1, 2^32]");
+    }
+
+    auto normalize = [](std::int64_t v, std::uint64_t size) {
+        const auto remainder = v % static_cast<std::int64_t>(size);
+        return static_cast<std::uint64_t>(remainder < 0 ? remainder + size : remainder);
+    };
+
+    robot_columns columns{
+        .width = width, .height = height, .px = {}, .py = {}, .vx = {}, .vy = {}};
     for (const auto &robot : robots) {
-        ++robot_counts[coordinates{robot.px, robot.py}];
+        columns.px.push_back(robot.px % width);
+        columns.py.push_back(robot.py % height);
+        columns.vx.push_back(normalize(robot.vx, width));
+        columns.vy.push_back(normalize(robot.vy, height));
+    }
+    return columns;
+}
+
+// Positions after n steps: p + (n mod size) * v < size^2 fits into 64 bits
+robot_columns simulate(const robot_columns &robots, std::uint64_t n) {
+    auto result = robots;
+    const auto n_x = n % robots.width;
+    const auto n_y = n % robots.height;
+    for (std::size_t i = 0; i < robots.size(); ++i) {
+        result.px[i] = (robots.px[i] + n_x * robots.vx[i]) % robots.width;
+        result.py[i] = (robots.py[i] + n_y * robots.vy[i]) % robots.height;
+    }
+    return result;
+}
+
+// Number of robots per quadrant in one branch-free pass, robots on the middle row or column do not
+// count. The order is top left, top right, bottom left, bottom right.
+std::array<std::size_t, 4> quadrant_counts(const robot_columns &robots) {
+    const auto mid_x = robots.width / 2;
+    const auto mid_y = robots.height / 2;
+    // Boards with an even side have no middle row or column
+    const auto odd_x = robots.width % 2;
+    const auto odd_y = robots.height % 2;
+
+    std::size_t top_left = 0;
+    std::size_t top_right = 0;
+    std::size_t bottom_left = 0;
+    std::size_t bottom_right = 0;
+    for (std::size_t i = 0; i < robots.size(); ++i) {
+        const std::size_t left = robots.px[i] < mid_x;
+        const std::size_t right = robots.px[i] >= mid_x + odd_x;
+        const std::size_t top = robots.py[i] < mid_y;
+        const std::size_t bottom = robots.py[i] >= mid_y + odd_y;
+        top_left += top & left;
+        top_right += top & right;
+        bottom_left += bottom & left;
+        bottom_right += bottom & right;
+    }
+    return {top_left, top_right, bottom_left, bottom_right};
+}
+
+std::size_t safety_factor(const robot_columns &robots) {
+    const auto [q0, q1, q2, q3] = quadrant_counts(robots);
+    return q0 * q1 * q2 * q3;
+}
+
+// Number of robots per cell, row by row. The robots are bucketed by bands of rows, then every
+// thread counts the robots of one band into its own rows of the result.
+std::vector<std::uint32_t> occupancy(const robot_columns &robots) {
+    const auto num_threads = std::max<std::size_t>(
+        1, std::min<std::size_t>(std::thread::hardware_concurrency(), robots.height));
+    const auto rows_per_band = (robots.height + num_threads - 1) / num_threads;
+    const auto num_bands = (robots.height + rows_per_band - 1) / rows_per_band;
+
+    // Counting sort of the robot indices by band
+    std::vector<std::size_t> band_begin(num_bands + 1);
+    for (std::size_t i = 0; i < robots.size(); ++i) {
+        ++band_begin[robots.py[i] / rows_per_band + 1];
+    }
+    std::partial_sum(band_begin.cbegin(), band_begin.cend(), band_begin.begin());
+    std::vector<std::size_t> by_band(robots.size());
+    {
+        auto next = band_begin;
+        for (std::size_t i = 0; i < robots.size(); ++i) {
+            by_band[next[robots.py[i] / rows_per_band]++] = i;
+        }
+    }
+
+    std::vector<std::uint32_t> counts(robots.width * robots.height);
+    {
+        std::vector<std::jthread> workers;
+        for (std::size_t band = 0; band < num_bands; ++band) {
+            workers.emplace_back([&, band]() {
+                for (auto j = band_begin[band]; j < band_begin[band + 1]; ++j) {
+                    const auto i = by_band[j];
+                    ++counts[robots.py[i] * robots.width + robots.px[i]];
+                }
+            });
+        }
     }
+    return counts;
+}
 
-    for (std::size_t row = 0; row < height; ++row) {
-        for (std::size_t col = 0; col < width; ++col) {
-            if (auto it = robot_counts.find(coordinates{col, row}); it != robot_counts.cend()) {
-                std::print("{}", it->second);
+void print_robots(const robot_columns &robots) {
+    const auto counts = occupancy(robots);
+    for (std::size_t row = 0; row < robots.height; ++row) {
+        for (std::size_t col = 0; col < robots.width; ++col) {
+            if (const auto count = counts[row * robots.width + col]; count != 0) {
+                std::print("{}", count);
             } else {
                 std::print(".");
             }
@@ -49,87 +167,111 @@ void print_robots(std::size_t width, std::size_t height, const std::vector<robot
     }
 }
 
-std::size_t mod(std::size_t a, std::size_t b) {
-    const auto remainder = static_cast<int>(a) % static_cast<int>(b);
-    if (remainder >= 0) {
-        return remainder;
+// One axis of all robots as structure of arrays. Velocities are normalized to [0, size), so a step
+// is an add and a conditional subtract.
+struct robot_axis {
+    std::int16_t size;
+    std::vector<std::int16_t> position;
+    std::vector<std::int16_t> velocity;
+};
+
+robot_axis to_axis(const std::vector<robot_state> &robots, std::size_t size,
+                   std::size_t robot_state::*position, int robot_state::*velocity) {
+    if (size == 0 || size > std::numeric_limits<std::int16_t>::max() / 2) {
+        throw std::invalid_argument("Board size does not fit into 16 bits");
     }
-    return remainder + b;
-}
 
-std::vector<robot_state> simulate_n(const std::vector<robot_state> &robots, std::size_t n,
-                                    std::size_t width, std::size_t height) {
-    std::vector<robot_state> robots_after_n_steps(robots);
-    for (auto &robot : robots_after_n_steps) {
-        const auto new_px = static_cast<int>(robot.px) + static_cast<int>(n) * robot.vx;
-        const auto new_py = static_cast<int>(robot.py) + static_cast<int>(n) * robot.vy;
-        robot.px = mod(new_px, width);
-        robot.py = mod(new_py, height);
+    robot_axis axis{.size = static_cast<std::int16_t>(size), .position = {}, .velocity = {}};
+    for (const auto &robot : robots) {
+        const auto v = static_cast<int>(robot.*velocity) % axis.size;
+        axis.position.push_back(static_cast<std::int16_t>(robot.*position % size));
+        axis.velocity.push_back(static_cast<std::int16_t>(v < 0 ? v + axis.size : v));
     }
-    return robots_after_n_steps;
+    return axis;
 }
 
-std::size_t safety_factor(const std::vector<robot_state> &robots, std::size_t width,
-                          std::size_t height) {
-    // Assumig odd width and height
-    const auto midpoint = std::make_pair(width / 2, height / 2);
-
-    const auto q0 = std::count_if(robots.cbegin(), robots.cend(), [midpoint](const auto &r) {
-        return r.px > midpoint.first && r.py > midpoint.second;
-    });
-    const auto q1 = std::count_if(robots.cbegin(), robots.cend(), [midpoint](const auto &r) {
-        return r.px > midpoint.first && r.py < midpoint.second;
-    });
-    const auto q2 = std::count_if(robots.cbegin(), robots.cend(), [midpoint](const auto &r) {
-        return r.px < midpoint.first && r.py > midpoint.second;
-    });
-    const auto q3 = std::count_if(robots.cbegin(), robots.cend(), [midpoint](const auto &r) {
-        return r.px < midpoint.first && r.py < midpoint.second;
-    });
-
-    return q0 * q1 * q2 * q3;
+// Moves the robots one step along the axis and returns n * sum(p^2) - sum(p)^2, which is the
+// variance of the positions times n^2
+__int128 step_axis(robot_axis &axis) {
+    const auto size = axis.size;
+    std::int64_t sum = 0;
+    std::int64_t sum_squares = 0;
+    for (std::size_t i = 0; i < axis.position.size(); ++i) {
+        auto p = static_cast<std::int16_t>(axis.position[i] + axis.velocity[i]);
+        p = static_cast<std::int16_t>(p >= size ? p - size : p);
+        axis.position[i] = p;
+        sum += p;
+        sum_squares += p * p;
+    }
+    const auto n = static_cast<__int128>(axis.position.size());
+    return n * sum_squares - static_cast<__int128>(sum) * sum;
 }
 
-std::pair<float, float> robot_variance(const std::vector<robot_state> &robots) {
-    const auto N = robots.size();
+// Step in [0, size) with the smallest variance along the axis. The positions repeat with period
+// size, so one period covers all steps.
+std::int64_t min_variance_step(robot_axis axis) {
+    std::int64_t best_step = 0;
+    auto best_spread = std::numeric_limits<__int128>::max();
+    for (std::int64_t step = 1; step <= axis.size; ++step) {
+        if (const auto spread = step_axis(axis); spread < best_spread) {
+            best_spread = spread;
+            best_step = step % axis.size;
+        }
+    }
+    return best_step;
+}
 
-    float xbar = 0, ybar = 0;
-    for (const auto &robot : robots) {
-        xbar += static_cast<float>(robot.px) / N;
-        ybar += static_cast<float>(robot.py) / N;
+// Smallest t >= 0 with t = a (mod m) and t = b (mod n), if there is one
+std::optional<std::int64_t> chinese_remainder(std::int64_t a, std::int64_t m, std::int64_t b,
+                                              std::int64_t n) {
+    // Extended gcd: m * x + n * y = g
+    std::int64_t g = m;
+    std::int64_t x = 1;
+    for (std::int64_t r = n, next_x = 0; r != 0;) {
+        const auto q = g / r;
+        g = std::exchange(r, g - q * r);
+        x = std::exchange(next_x, x - q * next_x);
+    }
+    if ((b - a) % g != 0) {
+        return {};
     }
 
-    float varx = 0, vary = 0;
-    for (const auto &robot : robots) {
-        varx += std::pow(static_cast<float>(robot.px) - xbar, 2) / N;
-        vary += std::pow(static_cast<float>(robot.py) - ybar, 2) / N;
+    const auto lcm = m / g * n;
+    const auto k = static_cast<__int128>((b - a) / g) * x % (n / g);
+    const auto t = (a + static_cast<__int128>(m) * k) % lcm;
+    return static_cast<std::int64_t>(t < 0 ? t + lcm : t);
+}
+
+// The robots form a picture when they are clustered on both axes. Every axis is periodic on its
+// own, so the steps with the smallest variance along x (period width) and along y (period height)
+// are searched separately and combined with the Chinese remainder theorem.
+std::int64_t find_picture(const std::vector<robot_state> &robots, std::size_t width,
+                          std::size_t height) {
+    const auto step_x =
+        min_variance_step(to_axis(robots, width, &robot_state::px, &robot_state::vx));
+    const auto step_y =
+        min_variance_step(to_axis(robots, height, &robot_state::py, &robot_state::vy));
+
+    const auto w = static_cast<std::int64_t>(width);
+    const auto h = static_cast<std::int64_t>(height);
+    const auto step = chinese_remainder(step_x, w, step_y, h);
+    if (!step) {
+        throw std::runtime_error("No step with minimum variance on both axes");
     }
-    return {varx, vary};
+    // Step 0 is the initial state, the picture appears after a full period
+    return *step == 0 ? std::lcm(w, h) : *step;
 }
 
 int main() {
     const auto width = 101uz;
     const auto height = 103uz;
     const auto robots = read_input(std::cin);
+    const auto columns = to_columns(robots, width, height);
 
-    const auto robots_after_100 = simulate_n(robots, 100, width, height);
-    const auto sf = safety_factor(robots_after_100, width, height);
-
-    std::println("Part 1: {}", sf);
+    std::println("Part 1: {}", safety_factor(simulate(columns, 100)));
 
-    auto seconds = 0uz;
-    auto robots_step = robots;
-    while (seconds < 100000) {
-        robots_step = simulate_n(robots_step, 1, width, height);
-        ++seconds;
-
-        const auto [varx, vary] = robot_variance(robots_step);
-        if (varx < 500 && vary < 500) {
-            std::println("seconds = {} varx = {} vary = {}", seconds, varx, vary);
-            break;
-        }
-    }
-    print_robots(width, height, robots_step);
+    const auto seconds = find_picture(robots, width, height);
+    print_robots(simulate(columns, seconds));
     std::println("Part 2: {}", seconds);
 
     return 0;
@@ -1,13 +1,13 @@
 #include <algorithm>
+#include <cstddef>
 #include <iostream>
 #include <print>
-#include <ranges>
-#include <set>
+#include <stdexcept>
 #include <string>
 #include <utility>
 #include <vector>
 
-enum class tile_type {
+enum class tile_type : char {
     wall = '#',
     empty = '.',
     box = 'O',
@@ -45,38 +45,39 @@ enum class move_direction {
     west = '<',
 };
 
-using warehouse = std::vector<std::vector<tile_type>>;
+// Tiles row by row in one byte array
+struct warehouse {
+    int num_rows = 0;
+    int num_cols = 0;
+    std::vector<tile_type> tiles;
+};
 
 warehouse read_warehouse(std::istream &istream) {
     warehouse g;
 
     std::string line;
     while (std::getline(istream, line) && line != "") {
-        auto row = line |
-                   std::views::transform([](char ch) { return static_cast<tile_type>(ch); }) |
-                   std::ranges::to<std::vector>();
-        g.emplace_back(std::move(row));
+        if (g.num_rows == 0) {
+            g.num_cols = static_cast<int>(line.size());
+        } else if (static_cast<int>(line.size()) != g.num_cols) {
+            throw std::runtime_error("rows of different length");
+        }
+        std::transform(line.cbegin(), line.cend(), std::back_inserter(g.tiles),
+                       [](char ch) { return static_cast<tile_type>(ch); });
+        ++g.num_rows;
     }
     return g;
 }
 
 warehouse to_wide_warehouse(const warehouse &g) {
-    warehouse new_wh;
-    new_wh.reserve(g.size());
-
-    for (const auto &row : g) {
-        std::vector<tile_type> new_row;
-        new_row.reserve(2 * row.size());
-
-        for (const auto t : row) {
-            const auto [left, right] = to_wide_tile(t);
-            new_row.push_back(left);
-            new_row.push_back(right);
-        }
+    warehouse new_wh{.num_rows = g.num_rows, .num_cols = 2 * g.num_cols, .tiles = {}};
+    new_wh.tiles.reserve(2 * g.tiles.size());
 
-        new_wh.emplace_back(std::move(new_row));
+    for (const auto t : g.tiles) {
+        const auto [left, right] = to_wide_tile(t);
+        new_wh.tiles.push_back(left);
+        new_wh.tiles.push_back(right);
     }
-
     return new_wh;
 }
 
@@ -91,15 +92,12 @@ std::vector<move_direction> read_moves(std::istream &istream) {
     return moves;
 }
 
-std::pair<std::size_t, std::size_t> find_robot(const warehouse &wh) {
-    for (std::size_t row = 0; row < wh.size(); ++row) {
-        for (std::size_t col = 0; col < wh[row].size(); ++col) {
-            if (wh[row][col] == tile_type::robot) {
-                return {row, col};
-            }
-        }
+int find_robot(const warehouse &wh) {
+    const auto it = std::find(wh.tiles.cbegin(), wh.tiles.cend(), tile_type::robot);
+    if (it == wh.tiles.cend()) {
+        throw std::runtime_error("did not find robot");
     }
-    throw std::runtime_error("did not find robot");
+    return static_cast<int>(it - wh.tiles.cbegin());
 }
 
 constexpr std::pair<int, int> move_to_direction(move_direction m) {
@@ -116,109 +114,267 @@ constexpr std::pair<int, int> move_to_direction(move_direction m) {
     std::unreachable();
 }
 
-bool move_box(std::size_t row, std::size_t col, move_direction m, warehouse &wh) {
-    using coordinates = std::pair<std::size_t, std::size_t>;
-    const auto dir = move_to_direction(m);
-
-    std::set<coordinates> visited;
-    std::vector<coordinates> boxes;
-    std::vector<coordinates> stack;
-    stack.emplace_back(coordinates{row, col});
-    while (!stack.empty()) {
-        const auto coords = stack.back();
-        const auto [box_row, box_col] = coords;
-        stack.pop_back();
+// Offset of the neighboring cell in direction m
+int cell_offset(const warehouse &wh, move_direction m) {
+    const auto [row, col] = move_to_direction(m);
+    return row * wh.num_cols + col;
+}
 
-        if (visited.contains(coords)) {
-            continue;
-        }
-        visited.insert(coords);
+// Buffers of move_box that are reused across pushes
+struct push_scratch {
+    std::vector<int> boxes;
+};
 
-        const auto t = wh[box_row][box_col];
+// Change of the GPS coordinate of a box moving one step in direction m
+constexpr std::ptrdiff_t gps_delta(move_direction m) {
+    const auto [row, col] = move_to_direction(m);
+    return 100 * row + col;
+}
 
-        if (t == tile_type::wall || t == tile_type::robot) {
-            return false; // not movable
-        } else if (t == tile_type::empty) {
-            continue;
+// Pushes the box at `cell` one step in direction m, together with all boxes it pushes. The boxes
+// are collected layer by layer along the push direction: every layer holds the box tiles that the
+// previous layer pushes, including the other halves of big boxes when pushing north or south. The
+// boxes are then moved in reverse order, so every tile is written after its destination has been
+// vacated. Every moved box changes `gps` by gps_delta(m).
+bool move_box(int cell, move_direction m, warehouse &wh, push_scratch &scratch, std::size_t &gps) {
+    const auto offset = cell_offset(wh, m);
+    const auto vertical = m == move_direction::north || m == move_direction::south;
+    auto &tiles = wh.tiles;
+    auto &boxes = scratch.boxes;
+    boxes.clear();
+
+    auto add = [&](int c) {
+        boxes.push_back(c);
+        if (vertical && tiles[c] == tile_type::big_box_left) {
+            boxes.push_back(c + 1);
+        } else if (vertical && tiles[c] == tile_type::big_box_right) {
+            boxes.push_back(c - 1);
         }
-        // Otherwise: must be a box, big_box_left, or big_box_right
-        boxes.push_back({box_row, box_col});
-
-        const auto next_tile = wh[box_row + dir.first][box_col + dir.second];
-        stack.emplace_back(box_row + dir.first, box_col + dir.second);
-
-        // If we are moving east or west the matching box pair will have been added above
-        if (m == move_direction::north || m == move_direction::south) {
-            if (t == tile_type::big_box_left) {
-                stack.push_back({box_row, box_col + 1});
-                stack.push_back({box_row + dir.first, box_col + dir.second + 1});
-            } else if (t == tile_type::big_box_right) {
-                stack.push_back({box_row, box_col - 1});
-                stack.push_back({box_row + dir.first, box_col + dir.second - 1});
+    };
+
+    add(cell);
+    for (std::size_t layer_begin = 0; layer_begin < boxes.size();) {
+        // Two boxes of a layer can push the same box
+        std::sort(boxes.begin() + layer_begin, boxes.end());
+        boxes.erase(std::unique(boxes.begin() + layer_begin, boxes.end()), boxes.end());
+
+        const auto layer_end = boxes.size();
+        for (auto i = layer_begin; i < layer_end; ++i) {
+            const auto next = boxes[i] + offset;
+            const auto t = tiles[next];
+            if (t == tile_type::wall || t == tile_type::robot) {
+                return false; // not movable
+            }
+            if (is_box(t)) {
+                add(next);
             }
         }
+        layer_begin = layer_end;
     }
 
-    // Perform the move
-    warehouse new_wh = wh;
-
-    for (const auto [row, col] : boxes) {
-        new_wh[row][col] = tile_type::empty;
+    std::ptrdiff_t num_moved = 0;
+    for (auto it = boxes.crbegin(); it != boxes.crend(); ++it) {
+        const auto t = tiles[*it];
+        num_moved += t == tile_type::box || t == tile_type::big_box_left;
+        tiles[*it + offset] = t;
+        tiles[*it] = tile_type::empty;
     }
-    for (const auto [row, col] : boxes) {
-        new_wh[row + dir.first][col + dir.second] = wh[row][col];
+    // Unsigned wrap-around subtracts for negative deltas
+    gps += static_cast<std::size_t>(num_moved * gps_delta(m));
+    return true;
+}
+
+std::size_t sum_of_box_gps_coordinates(const warehouse &wh) {
+    std::size_t total = 0;
+    for (int cell = 0; cell < static_cast<int>(wh.tiles.size()); ++cell) {
+        const auto tile = wh.tiles[cell];
+        if (tile == tile_type::box || tile == tile_type::big_box_left) {
+            total += 100 * (cell / wh.num_cols) + cell % wh.num_cols;
+        }
     }
+    return total;
+}
 
-    wh = std::move(new_wh);
-    return true;
+// Warehouse during a simulation with the robot position and the GPS sum of the boxes
+struct simulation_state {
+    warehouse wh;
+    int robot;
+    std::size_t gps;
+};
+
+simulation_state start_simulation(warehouse wh) {
+    const auto robot = find_robot(wh);
+    const auto gps = sum_of_box_gps_coordinates(wh);
+    return {.wh = std::move(wh), .robot = robot, .gps = gps};
 }
 
-void simulate(warehouse &wh, const std::vector<move_direction> &moves) {
-    auto [robot_row, robot_col] = find_robot(wh);
+void apply_move(simulation_state &state, move_direction m, push_scratch &scratch) {
+    auto &tiles = state.wh.tiles;
+    const auto dest = state.robot + cell_offset(state.wh, m);
+
+    const auto dest_tile = tiles[dest];
+    if (dest_tile == tile_type::wall) {
+        // Facing wall: do nothing
+    } else if (dest_tile == tile_type::empty ||
+               (is_box(dest_tile) && move_box(dest, m, state.wh, scratch, state.gps))) {
+        // Empty space or boxes were moved: move the robot one step
+        tiles[state.robot] = tile_type::empty;
+        tiles[dest] = tile_type::robot;
+        state.robot = dest;
+    }
+}
 
+// Returns the GPS sum of the boxes after all moves
+std::size_t simulate(warehouse &wh, const std::vector<move_direction> &moves) {
+    auto state = start_simulation(std::move(wh));
+    push_scratch scratch;
     for (const auto m : moves) {
-        const auto direction = move_to_direction(m);
-
-        std::size_t robot_dest_row = robot_row + direction.first;
-        std::size_t robot_dest_col = robot_col + direction.second;
-
-        const auto dest_tile = wh[robot_dest_row][robot_dest_col];
-        if (dest_tile == tile_type::wall) {
-            // Facing wall: do nothing
-        } else if (dest_tile == tile_type::empty) {
-            // Empty space: move one step
-            wh[robot_row][robot_col] = tile_type::empty;
-            wh[robot_dest_row][robot_dest_col] = tile_type::robot;
-            robot_row = robot_dest_row;
-            robot_col = robot_dest_col;
-        } else if (is_box(dest_tile)) {
-            if (move_box(robot_dest_row, robot_dest_col, m, wh)) {
-                // Boxes were moved -> move the robot
-                wh[robot_row][robot_col] = tile_type::empty;
-                wh[robot_dest_row][robot_dest_col] = tile_type::robot;
-                robot_row = robot_dest_row;
-                robot_col = robot_dest_col;
-            }
+        apply_move(state, m, scratch);
+    }
+    wh = std::move(state.wh);
+    return state.gps;
+}
+
+// GPS sums after 0, k, 2k, ... moves, up to the last multiple of k. With k = 1 this is the sum
+// after every move.
+std::vector<std::size_t> gps_trajectory(warehouse wh, const std::vector<move_direction> &moves,
+                                        std::size_t k) {
+    if (k == 0) {
+        throw std::invalid_argument("k must be positive");
+    }
+
+    auto state = start_simulation(std::move(wh));
+    push_scratch scratch;
+    std::vector<std::size_t> trajectory;
+    trajectory.reserve(moves.size() / k + 1);
+    trajectory.push_back(state.gps);
+    for (std::size_t i = 0; i < moves.size(); ++i) {
+        apply_move(state, moves[i], scratch);
+        if ((i + 1) % k == 0) {
+            trajectory.push_back(state.gps);
         }
     }
+    return trajectory;
 }
 
-std::size_t sum_of_box_gps_coordinates(const warehouse &wh) {
-    std::size_t total = 0;
-    for (const auto &[row_idx, row] : wh | std::views::enumerate) {
-        for (const auto &[col_idx, tile] : row | std::views::enumerate) {
-            if (tile == tile_type::box || tile == tile_type::big_box_left) {
-                total += 100 * row_idx + col_idx;
+// Replays a move script with a full snapshot of the state every `interval` moves and, in between,
+// a log of the tiles each move changed. A query for the state after k moves restores the closest
+// snapshot before it and writes the logged tiles of the remaining moves instead of pushing boxes
+// again.
+class replay_engine {
+  public:
+    replay_engine(warehouse wh, std::vector<move_direction> moves, std::size_t interval = 1024)
+        : interval(interval), moves(std::move(moves)) {
+        if (interval == 0) {
+            throw std::invalid_argument("interval must be positive");
+        }
+        run(start_simulation(std::move(wh)), 0);
+    }
+
+    std::size_t num_moves() const { return moves.size(); }
+
+    // State after the first k moves
+    simulation_state state_at(std::size_t k) const {
+        if (k > moves.size()) {
+            throw std::out_of_range("move index out of range");
+        }
+
+        const auto s = std::min(k / interval, snapshots.size() - 1);
+        auto state = snapshots[s];
+        const auto first_move = s * interval;
+        const auto begin = first_move == 0 ? 0 : changes_end[first_move - 1];
+        const auto end = k == 0 ? 0 : changes_end[k - 1];
+        for (auto i = begin; i < end; ++i) {
+            const auto [cell, tile] = changes[i];
+            state.wh.tiles[cell] = tile;
+            if (tile == tile_type::robot) {
+                state.robot = cell;
             }
         }
+        if (k > first_move) {
+            state.gps = gps_after[k - 1];
+        }
+        return state;
     }
-    return total;
+
+    // Replaces the moves from index k on with `tail` and simulates them from the state after k
+    // moves
+    void replace_moves(std::size_t k, const std::vector<move_direction> &tail) {
+        auto state = state_at(k);
+
+        moves.resize(k);
+        moves.insert(moves.end(), tail.cbegin(), tail.cend());
+        snapshots.resize((k + interval - 1) / interval);
+        changes.resize(k == 0 ? 0 : changes_end[k - 1]);
+        changes_end.resize(k);
+        gps_after.resize(k);
+
+        run(std::move(state), k);
+    }
+
+  private:
+    struct tile_change {
+        int cell;
+        tile_type tile;
+    };
+
+    // Simulates moves [begin, end) from `state`, the state after `begin` moves
+    void run(simulation_state state, std::size_t begin) {
+        push_scratch scratch;
+        for (auto i = begin; i < moves.size(); ++i) {
+            if (i % interval == 0) {
+                snapshots.push_back(state);
+            }
+
+            const auto m = moves[i];
+            const auto robot = state.robot;
+            const auto offset = cell_offset(state.wh, m);
+            const auto pushes = is_box(state.wh.tiles[robot + offset]);
+            apply_move(state, m, scratch);
+
+            if (state.robot != robot) {
+                auto log = [&](int cell) { changes.push_back({cell, state.wh.tiles[cell]}); };
+                log(robot);
+                log(state.robot);
+                if (pushes) {
+                    for (const auto box : scratch.boxes) {
+                        log(box);
+                        log(box + offset);
+                    }
+                }
+            }
+            changes_end.push_back(changes.size());
+            gps_after.push_back(state.gps);
+        }
+        if (snapshots.empty()) {
+            snapshots.push_back(std::move(state));
+        }
+    }
+
+    std::size_t interval;
+    std::vector<move_direction> moves;
+    // Snapshot i is the state after i * interval moves
+    std::vector<simulation_state> snapshots;
+    // The tiles changed by move i are [changes_end[i - 1], changes_end[i])
+    std::vector<tile_change> changes;
+    std::vector<std::size_t> changes_end;
+    std::vector<std::size_t> gps_after;
+};
+
+replay_engine replay(const warehouse &wh, const std::vector<move_direction> &moves,
+                     std::size_t interval = 1024) {
+    return replay_engine(wh, moves, interval);
+}
+
+replay_engine replay_wide(const warehouse &wh, const std::vector<move_direction> &moves,
+                          std::size_t interval = 1024) {
+    return replay_engine(to_wide_warehouse(wh), moves, interval);
 }
 
 void print_grid(const warehouse &grid) {
-    for (const auto &row : grid) {
-        for (const auto tile : row) {
-            std::print("{}", static_cast<char>(tile));
+    for (int row = 0; row < grid.num_rows; ++row) {
+        for (int col = 0; col < grid.num_cols; ++col) {
+            std::print("{}", static_cast<char>(grid.tiles[row * grid.num_cols + col]));
         }
         std::print("\n");
     }
@@ -229,13 +385,9 @@ int main() {
     const auto moves = read_moves(std::cin);
 
     auto wh_clone = wh;
-    simulate(wh_clone, moves);
-
-    std::println("Part 1: {}", sum_of_box_gps_coordinates(wh_clone));
+    std::println("Part 1: {}", simulate(wh_clone, moves));
 
     auto wh_wide = to_wide_warehouse(wh);
-    simulate(wh_wide, moves);
-
-    std::println("Part 2: {}", sum_of_box_gps_coordinates(wh_wide));
+    std::println("Part 2: {}", simulate(wh_wide, moves));
     return 0;
 }
@@ -1,26 +1,18 @@
 #include <algorithm>
-#include <cmath>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <format>
+#include <functional>
 #include <iostream>
-#include <map>
+#include <limits>
 #include <optional>
 #include <print>
-#include <ranges>
-#include <set>
+#include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
-struct position {
-    std::size_t row;
-    std::size_t col;
-    constexpr auto operator<=>(const position &other) const = default;
-};
-
-struct maze {
-    position start;
-    position end;
-    std::set<position> walls;
-};
-
 enum class orientation {
     north = 0,
     east = 1,
@@ -28,43 +20,70 @@ enum class orientation {
     west = 3,
 };
 
-struct path {
-    position pos;
-    orientation orient;
-    std::size_t cost;
-    std::vector<position> pos_history;
+constexpr int num_orientations = 4;
+
+class bit_grid {
+  public:
+    bit_grid(int num_rows, int num_cols)
+        : bits((static_cast<std::size_t>(num_rows) * num_cols + 63) / 64) {}
 
-    constexpr bool operator<(const path &other) const { return cost < other.cost; }
+    bool test(int cell) const { return (bits[cell / 64] >> (cell % 64)) & 1; }
 
-    constexpr bool operator>(const path &other) const { return cost > other.cost; }
+    void set(int cell) { bits[cell / 64] |= std::uint64_t{1} << (cell % 64); }
+
+    std::size_t count() const {
+        std::size_t total = 0;
+        for (const auto word : bits) {
+            total += std::popcount(word);
+        }
+        return total;
+    }
+
+  private:
+    std::vector<std::uint64_t> bits;
 };
 
-[[nodiscard]]
-std::size_t get_number_of_turns(orientation from, orientation to) {
-    const auto from_int = static_cast<int>(from);
-    const auto to_int = static_cast<int>(to);
-    const auto dist = std::abs(from_int - to_int);
-    return std::min(dist, 4 - dist);
-}
+struct maze {
+    int num_rows = 0;
+    int num_cols = 0;
+    int start = 0;
+    int end = 0;
+    bit_grid walls{0, 0};
 
-maze read_input(std::istream &is) {
-    std::set<position> walls;
-    std::optional<position> start;
-    std::optional<position> end;
+    int num_cells() const { return num_rows * num_cols; }
+};
 
+maze read_input(std::istream &is) {
+    std::vector<std::string> lines;
     std::string line;
-    auto row = 0uz;
     while (std::getline(is, line)) {
-        for (const auto [col, ch] : line | std::views::enumerate) {
-            switch (ch) {
+        lines.push_back(std::move(line));
+    }
+    if (lines.empty()) {
+        throw std::runtime_error("empty maze");
+    }
+
+    maze m{.num_rows = static_cast<int>(lines.size()),
+           .num_cols = static_cast<int>(lines.front().size())};
+    m.walls = bit_grid(m.num_rows, m.num_cols);
+
+    std::optional<int> start;
+    std::optional<int> end;
+    for (int row = 0; row < m.num_rows; ++row) {
+        if (static_cast<int>(lines[row].size()) != m.num_cols) {
+            throw std::runtime_error("rows of different length");
+        }
+        for (int col = 0; col < m.num_cols; ++col) {
+            const auto cell = row * m.num_cols + col;
+            switch (const auto ch = lines[row][col]) {
             case '#':
-                walls.emplace(row, col);
+                m.walls.set(cell);
                 break;
             case 'S':
-                start = {row, static_cast<std::size_t>(col)};
+                start = cell;
                 break;
             case 'E':
-                end = {row, static_cast<std::size_t>(col)};
+                end = cell;
                 break;
             case '.':
                 break;
@@ -72,7 +91,6 @@ maze read_input(std::istream &is) {
                 throw std::runtime_error(std::format("Unknown input '{}'", ch));
             }
         }
-        ++row;
     }
 
     if (!start) {
@@ -81,141 +99,169 @@ maze read_input(std::istream &is) {
     if (!end) {
         throw std::runtime_error("maze end not found");
     }
-
-    return {*start, *end, std::move(walls)};
+    m.start = *start;
+    m.end = *end;
+    return m;
 }
 
-void print_maze(const auto &m) {
-    const auto num_rows =
-        std::ranges::max(m.walls | std::views::transform([](const auto &p) { return p.row; })) + 1;
-    const auto num_cols =
-        std::ranges::max(m.walls | std::views::transform([](const auto &p) { return p.col; })) + 1;
-
-    for (std::size_t row = 0; row < num_rows; ++row) {
-        for (std::size_t col = 0; col < num_cols; ++col) {
-            if (m.walls.contains({row, col})) {
-                std::print("#");
-            } else if (position{row, col} == m.start) {
-                std::print("S");
-            } else if (position{row, col} == m.end) {
-                std::print("E");
-            } else {
-                std::print(".");
-            }
+void print_maze(const maze &m) {
+    for (int cell = 0; cell < m.num_cells(); ++cell) {
+        if (m.walls.test(cell)) {
+            std::print("#");
+        } else if (cell == m.start) {
+            std::print("S");
+        } else if (cell == m.end) {
+            std::print("E");
+        } else {
+            std::print(".");
+        }
+        if (cell % m.num_cols == m.num_cols - 1) {
+            std::println("");
         }
-        std::println("");
     }
 }
 
-void push_path_to_heap(const auto &candidate_path, orientation orient, std::vector<path> &paths) {
-    const auto number_of_turns = get_number_of_turns(candidate_path.orient, orient);
-    const auto new_cost = candidate_path.cost + 1000 * number_of_turns + 1;
-
-    auto [row, col] = candidate_path.pos;
-    switch (orient) {
+// Neighbor of `cell` in direction `orient`, or nothing outside of the maze or on a wall
+std::optional<int> step(const maze &m, int cell, int orient) {
+    const auto row = cell / m.num_cols;
+    const auto col = cell % m.num_cols;
+    int next = -1;
+    switch (static_cast<orientation>(orient)) {
     case orientation::north:
-        row -= 1;
+        next = row > 0 ? cell - m.num_cols : -1;
         break;
     case orientation::east:
-        col += 1;
+        next = col + 1 < m.num_cols ? cell + 1 : -1;
         break;
     case orientation::south:
-        row += 1;
+        next = row + 1 < m.num_rows ? cell + m.num_cols : -1;
         break;
     case orientation::west:
-        col -= 1;
+        next = col > 0 ? cell - 1 : -1;
         break;
     }
-
-    auto pos_history = candidate_path.pos_history;
-    pos_history.emplace_back(candidate_path.pos);
-
-    paths.emplace_back(path{.pos = {.row = row, .col = col},
-                            .orient = orient,
-                            .cost = new_cost,
-                            .pos_history = std::move(pos_history)});
-    std::push_heap(paths.begin(), paths.end(), std::greater<>());
+    if (next < 0 || m.walls.test(next)) {
+        return {};
+    }
+    return next;
 }
 
-std::vector<path> solve_maze(const maze &m) {
-    std::vector<path> best_paths;
-    std::optional<std::size_t> best_cost;
-
-    std::vector<path> paths;
-    paths.emplace_back(path{.pos = m.start, .orient = orientation::east, .cost = 0});
-    std::push_heap(paths.begin(), paths.end(), std::greater<>());
+constexpr std::size_t step_cost = 1;
+constexpr std::size_t turn_cost = 1000;
 
-    std::map<std::pair<position, orientation>, std::size_t> min_cost_by_location;
+// Predecessors of a state as a bitmask: a step forward from the previous cell, or a turn from the
+// orientation clockwise or counterclockwise of it
+constexpr std::uint8_t from_step = 1;
+constexpr std::uint8_t from_clockwise = 2;
+constexpr std::uint8_t from_counterclockwise = 4;
 
-    while (true) {
-        std::pop_heap(paths.begin(), paths.end(), std::greater<>());
-        const auto candidate_path = paths.back();
-        paths.pop_back();
+struct maze_solution {
+    std::size_t cost = 0;
+    std::size_t num_tiles = 0; // Tiles on any best path
+};
 
-        if (best_cost && candidate_path.cost > *best_cost) {
-            break;
+// Dijkstra over the states (cell, orientation), numbered cell * 4 + orientation. Every state keeps
+// its distance and the set of predecessors on shortest paths to it; walking this DAG backwards
+// from the cheapest end states marks every tile on a best path.
+std::optional<maze_solution> solve_maze(const maze &m) {
+    constexpr auto unreachable = std::numeric_limits<std::size_t>::max();
+    const auto num_states = static_cast<std::size_t>(m.num_cells()) * num_orientations;
+
+    std::vector<std::size_t> dist(num_states, unreachable);
+    std::vector<std::uint8_t> predecessors(num_states);
+
+    using entry = std::pair<std::size_t, int>;
+    std::vector<entry> heap;
+    auto relax = [&](int state, std::size_t cost, std::uint8_t predecessor) {
+        if (cost < dist[state]) {
+            dist[state] = cost;
+            predecessors[state] = predecessor;
+            heap.emplace_back(cost, state);
+            std::push_heap(heap.begin(), heap.end(), std::greater<>());
+        } else if (cost == dist[state]) {
+            predecessors[state] |= predecessor;
         }
-
-        if (candidate_path.pos == m.end) {
-            best_paths.push_back(candidate_path);
-            best_cost = candidate_path.cost;
+    };
+
+    relax(m.start * num_orientations + static_cast<int>(orientation::east), 0, 0);
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+        const auto [cost, state] = heap.back();
+        heap.pop_back();
+        if (cost > dist[state]) {
             continue;
         }
 
-        if (auto it = min_cost_by_location.find({candidate_path.pos, candidate_path.orient});
-            it != min_cost_by_location.end() && it->second < candidate_path.cost) {
-            continue;
-        } else {
-            min_cost_by_location[{candidate_path.pos, candidate_path.orient}] = candidate_path.cost;
+        const auto cell = state / num_orientations;
+        const auto orient = state % num_orientations;
+        if (const auto next = step(m, cell, orient)) {
+            relax(*next * num_orientations + orient, cost + step_cost, from_step);
         }
+        // Turning clockwise reaches a state whose counterclockwise neighbor is this one
+        const auto base = cell * num_orientations;
+        relax(base + (orient + 1) % num_orientations, cost + turn_cost, from_counterclockwise);
+        relax(base + (orient + 3) % num_orientations, cost + turn_cost, from_clockwise);
+    }
 
-        const auto [row, col] = candidate_path.pos;
+    const auto end_states = dist.cbegin() + static_cast<std::size_t>(m.end) * num_orientations;
+    const auto best_cost = *std::min_element(end_states, end_states + num_orientations);
+    if (best_cost == unreachable) {
+        return {};
+    }
 
-        // We disallow backtracking / 180 degree turns as this will always incur a higher cost
-        // North
-        if (candidate_path.orient != orientation::south && !m.walls.contains({row - 1, col})) {
-            push_path_to_heap(candidate_path, orientation::north, paths);
+    // Backward traversal of the predecessor DAG
+    bit_grid tiles(m.num_rows, m.num_cols);
+    std::vector<bool> visited(num_states);
+    std::vector<int> stack;
+    for (int orient = 0; orient < num_orientations; ++orient) {
+        if (end_states[orient] == best_cost) {
+            stack.push_back(m.end * num_orientations + orient);
+            visited[stack.back()] = true;
         }
-        // East
-        if (candidate_path.orient != orientation::west && !m.walls.contains({row, col + 1})) {
-            push_path_to_heap(candidate_path, orientation::east, paths);
+    }
+    while (!stack.empty()) {
+        const auto state = stack.back();
+        stack.pop_back();
+
+        const auto cell = state / num_orientations;
+        const auto orient = state % num_orientations;
+        tiles.set(cell);
+
+        std::array<int, 3> previous;
+        std::size_t num_previous = 0;
+        const auto mask = predecessors[state];
+        if (mask & from_step) {
+            const auto back = step(m, cell, (orient + 2) % num_orientations);
+            previous[num_previous++] = *back * num_orientations + orient;
         }
-        // South
-        if (candidate_path.orient != orientation::north && !m.walls.contains({row + 1, col})) {
-            push_path_to_heap(candidate_path, orientation::south, paths);
+        const auto base = cell * num_orientations;
+        if (mask & from_clockwise) {
+            previous[num_previous++] = base + (orient + 1) % num_orientations;
         }
-        // West
-        if (candidate_path.orient != orientation::east && !m.walls.contains({row, col - 1})) {
-            push_path_to_heap(candidate_path, orientation::west, paths);
+        if (mask & from_counterclockwise) {
+            previous[num_previous++] = base + (orient + 3) % num_orientations;
         }
-    }
 
-    return best_paths;
-}
-
-void print_vec(std::vector<path> vec) {
-    for (const auto &elem : vec) {
-        std::print("{}, ", elem.cost);
+        for (std::size_t i = 0; i < num_previous; ++i) {
+            if (!visited[previous[i]]) {
+                visited[previous[i]] = true;
+                stack.push_back(previous[i]);
+            }
+        }
     }
-    std::println("");
+
+    return maze_solution{.cost = best_cost, .num_tiles = tiles.count()};
 }
 
 int main() {
     const auto m = read_input(std::cin);
-    const auto best_paths = solve_maze(m);
-
-    std::println("Part 1: {}", best_paths.front().cost);
-
-    // TODO: Could use backtracking instead of brute force for part 2
-    std::set<position> visited_locations;
-    for (const auto &path : best_paths) {
-        for (const auto loc : path.pos_history) {
-            visited_locations.insert(loc);
-        }
+    const auto solution = solve_maze(m);
+    if (!solution) {
+        throw std::runtime_error("maze end not reachable");
     }
 
-    // Add one because we have to count the end of the maze (which is not part of the path history)
-    std::println("Part 2: {}", visited_locations.size() + 1);
+    std::println("Part 1: {}", solution->cost);
+    std::println("Part 2: {}", solution->num_tiles);
 
     return 0;
 }
@@ -1,18 +1,88 @@
 #include <absl/strings/str_split.h>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <exception>
 #include <iostream>
+#include <limits>
 #include <optional>
+#include <span>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Page numbers are interned to dense ids at parse time
+using page_id = std::uint16_t;
 
 struct rule {
-    const std::string lhs;
-    const std::string rhs;
+    page_id lhs;
+    page_id rhs;
 };
 
-using pages = std::vector<std::string>;
+using pages = std::vector<page_id>;
+
+class page_table {
+  public:
+    page_id intern(std::string_view name) {
+        const auto [it, inserted] = ids.try_emplace(std::string(name), numbers.size());
+        if (inserted) {
+            if (numbers.size() > std::numeric_limits<page_id>::max()) {
+                throw std::runtime_error("Too many distinct page numbers");
+            }
+            numbers.push_back(std::stoi(it->first));
+        }
+        return it->second;
+    }
+
+    int number(page_id id) const { return numbers[id]; }
+    std::size_t size() const { return numbers.size(); }
+
+  private:
+    std::unordered_map<std::string, page_id> ids;
+    std::vector<int> numbers;
+};
+
+// Bitset adjacency matrix: bit (lhs, rhs) is set if a rule "lhs|rhs" exists. The transpose is
+// kept as well so that the pages that must come before a given page are a single row.
+class rule_matrix {
+  public:
+    rule_matrix(std::size_t num_pages, const std::vector<rule> &rules)
+        : stride((num_pages + 63) / 64), after(num_pages * stride), before(num_pages * stride) {
+        for (const auto &r : rules) {
+            after[r.lhs * stride + r.rhs / 64] |= std::uint64_t{1} << (r.rhs % 64);
+            before[r.rhs * stride + r.lhs / 64] |= std::uint64_t{1} << (r.lhs % 64);
+        }
+    }
+
+    bool precedes(page_id lhs, page_id rhs) const {
+        return (after[lhs * stride + rhs / 64] >> (rhs % 64)) & 1;
+    }
+
+    std::span<const std::uint64_t> successors(page_id id) const {
+        return {after.data() + id * stride, stride};
+    }
+    std::span<const std::uint64_t> predecessors(page_id id) const {
+        return {before.data() + id * stride, stride};
+    }
+
+    std::size_t words() const { return stride; }
 
-std::pair<std::vector<rule>, std::vector<pages>> read_input(std::istream &istream) {
+  private:
+    std::size_t stride;
+    std::vector<std::uint64_t> after;
+    std::vector<std::uint64_t> before;
+};
+
+struct puzzle_input {
+    page_table table;
     std::vector<rule> rules;
     std::vector<pages> manuals;
+};
+
+puzzle_input read_input(std::istream &istream) {
+    puzzle_input input;
 
     std::string line;
     while (std::getline(istream, line)) {
@@ -21,63 +91,148 @@ std::pair<std::vector<rule>, std::vector<pages>> read_input(std::istream &istrea
         }
 
         // Rules
-        const std::pair<std::string, std::string> rule = absl::StrSplit(line, "|");
+        const std::pair<std::string_view, std::string_view> rule = absl::StrSplit(line, "|");
         if (rule.second.size() > 0) {
-            rules.push_back({.lhs = rule.first, .rhs = rule.second});
+            input.rules.push_back(
+                {.lhs = input.table.intern(rule.first), .rhs = input.table.intern(rule.second)});
             continue;
         }
 
         // Manuals
-        const pages p = absl::StrSplit(line, ",");
+        const std::vector<std::string_view> p = absl::StrSplit(line, ",");
         if (p.size() > 0) {
-            manuals.emplace_back(std::move(p));
+            pages manual;
+            manual.reserve(p.size());
+            for (const auto name : p) {
+                manual.push_back(input.table.intern(name));
+            }
+            input.manuals.emplace_back(std::move(manual));
         }
     }
 
-    return std::make_pair(rules, manuals);
+    return input;
 }
 
-std::optional<bool> less_than(const std::string &lhs, const std::string &rhs,
-                              const std::map<std::pair<std::string, std::string>, bool> &rules) {
-    const auto it = rules.find(std::make_pair(lhs, rhs));
-    if (it != rules.cend()) {
-        return it->second;
+std::optional<bool> less_than(page_id lhs, page_id rhs, const rule_matrix &rules) {
+    if (rules.precedes(lhs, rhs)) {
+        return true;
+    }
+    if (rules.precedes(rhs, lhs)) {
+        return false;
     }
     return {};
 }
 
-int main() {
-    const auto [rules, manuals] = read_input(std::cin);
+bool is_ordered(const pages &manual, const rule_matrix &rules) {
+    for (std::size_t i = 1; i < manual.size(); ++i) {
+        const auto lt = less_than(manual[i - 1], manual[i], rules);
+        if (!lt) {
+            throw std::runtime_error("Encountered unknown comparison");
+        }
+        if (!*lt) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    std::map<std::pair<std::string, std::string>, bool> rulemap;
-    for (const auto &rule : rules) {
-        rulemap[std::make_pair(rule.lhs, rule.rhs)] = true;
-        rulemap[std::make_pair(rule.rhs, rule.lhs)] = false;
+std::size_t count_common(std::span<const std::uint64_t> lhs, std::span<const std::uint64_t> rhs) {
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < lhs.size(); ++i) {
+        total += std::popcount(lhs[i] & rhs[i]);
     }
+    return total;
+}
 
-    auto fn_comp = [&rulemap](const auto &lhs, const auto &rhs) {
-        auto lt = less_than(lhs, rhs, rulemap);
-        if (!lt) {
-            throw std::runtime_error("Encountered unknown comparison");
+// Middle page of the sorted manual without sorting: the page with exactly len / 2 pages of the
+// manual before it. `mask` is zeroed scratch space of rules.words() words and is zeroed on return.
+page_id middle_page(const pages &manual, const rule_matrix &rules,
+                    std::vector<std::uint64_t> &mask) {
+    for (const auto id : manual) {
+        mask[id / 64] |= std::uint64_t{1} << (id % 64);
+    }
+    auto clear_mask = [&]() {
+        for (const auto id : manual) {
+            mask[id / 64] = 0;
         }
-        return *lt;
     };
 
-    int total_pt1 = 0;
-    int total_pt2 = 0;
-    for (const auto &manual : manuals) {
-        auto sorted_copy = manual;
-        std::sort(sorted_copy.begin(), sorted_copy.end(), fn_comp);
-
-        const auto len = sorted_copy.size();
-        const auto value = sorted_copy.at(len / 2);
-        if (sorted_copy == manual) {
-            total_pt1 += std::stoi(value);
-        } else {
-            total_pt2 += std::stoi(value);
+    const auto len = manual.size();
+    for (const auto id : manual) {
+        const auto num_before = count_common(rules.predecessors(id), mask);
+        const auto num_after = count_common(rules.successors(id), mask);
+        if (num_before + num_after != len - 1) {
+            clear_mask();
+            throw std::runtime_error("Encountered unknown comparison");
+        }
+        if (num_before == len / 2) {
+            clear_mask();
+            return id;
         }
     }
 
+    clear_mask();
+    throw std::runtime_error("Rules do not define a total order");
+}
+
+struct totals {
+    long pt1 = 0;
+    long pt2 = 0;
+};
+
+totals sum_middle_pages(const std::vector<pages> &manuals, const rule_matrix &rules,
+                        const page_table &table) {
+    const auto num_threads = std::max<std::size_t>(
+        1, std::min<std::size_t>(std::thread::hardware_concurrency(), manuals.size()));
+    const auto chunk_size = (manuals.size() + num_threads - 1) / num_threads;
+
+    std::vector<totals> partial(num_threads);
+    std::vector<std::exception_ptr> errors(num_threads);
+    {
+        std::vector<std::jthread> workers;
+        for (std::size_t t = 0; t < num_threads; ++t) {
+            workers.emplace_back([&, t]() {
+                try {
+                    totals local;
+                    std::vector<std::uint64_t> mask(rules.words());
+                    const auto begin = std::min(t * chunk_size, manuals.size());
+                    const auto end = std::min(begin + chunk_size, manuals.size());
+                    for (auto i = begin; i < end; ++i) {
+                        const auto &manual = manuals[i];
+                        if (manual.empty()) {
+                            throw std::out_of_range("Empty manual");
+                        }
+                        if (is_ordered(manual, rules)) {
+                            local.pt1 += table.number(manual[manual.size() / 2]);
+                        } else {
+                            local.pt2 += table.number(middle_page(manual, rules, mask));
+                        }
+                    }
+                    partial[t] = local;
+                } catch (...) {
+                    errors[t] = std::current_exception();
+                }
+            });
+        }
+    }
+
+    totals result;
+    for (std::size_t t = 0; t < num_threads; ++t) {
+        if (errors[t]) {
+            std::rethrow_exception(errors[t]);
+        }
+        result.pt1 += partial[t].pt1;
+        result.pt2 += partial[t].pt2;
+    }
+    return result;
+}
+
+int main() {
+    const auto [table, rules, manuals] = read_input(std::cin);
+    const rule_matrix rulemap(table.size(), rules);
+
+    const auto [total_pt1, total_pt2] = sum_middle_pages(manuals, rulemap, table);
+
     std::clog << "Part 1: " << total_pt1 << "\n";
     std::clog << "Part 2: " << total_pt2 << "\n";
 
@@ -1,8 +1,12 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <optional>
-#include <set>
+#include <span>
 #include <string>
+#include <thread>
 #include <vector>
 
 struct guard_pos {
@@ -10,131 +14,549 @@ struct guard_pos {
     int col;
     int dir_row;
     int dir_col;
+};
+
+// Directions in turning order: up, right, down, left
+constexpr int num_directions = 4;
+constexpr int dir_rows[num_directions] = {-1, 0, 1, 0};
+constexpr int dir_cols[num_directions] = {0, 1, 0, -1};
 
-    bool operator<(const guard_pos &other) const {
-        return std::tie(this->row, this->col, this->dir_row, this->dir_col) <
-               std::tie(other.row, other.col, other.dir_row, other.dir_col);
+int direction_index(int dir_row, int dir_col) {
+    for (int dir = 0; dir < num_directions; ++dir) {
+        if (dir_rows[dir] == dir_row && dir_cols[dir] == dir_col) {
+            return dir;
+        }
     }
+    throw std::runtime_error("Invalid guard direction");
+}
+
+struct floor_plan {
+    int num_rows = 0;
+    int num_cols = 0;
+    std::vector<std::uint8_t> obstructions;
+
+    int cell(int row, int col) const { return row * num_cols + col; }
+    int num_cells() const { return num_rows * num_cols; }
 };
 
-std::pair<std::vector<std::vector<bool>>, guard_pos> read_input(std::istream &istream) {
-    std::vector<std::vector<bool>> obstructions;
-    guard_pos guard;
+std::pair<floor_plan, guard_pos> read_input(std::istream &istream) {
+    floor_plan plan;
+    std::optional<guard_pos> guard;
 
-    std::size_t n_row = 0;
     std::string line;
     while (std::getline(istream, line)) {
+        if (plan.num_rows == 0) {
+            plan.num_cols = static_cast<int>(line.size());
+        } else if (static_cast<int>(line.size()) != plan.num_cols) {
+            throw std::runtime_error("Invalid input: rows of different length");
+        }
+
         // Parse obstructions
-        std::vector<bool> row;
-        std::transform(line.cbegin(), line.cend(), std::back_inserter(row),
+        std::transform(line.cbegin(), line.cend(), std::back_inserter(plan.obstructions),
                        [](const char c) { return c == '#'; });
-        obstructions.emplace_back(std::move(row));
 
         // Find guard
         auto guard_col = line.find('^');
         if (guard_col != std::string::npos) {
-            guard = {.row = static_cast<int>(n_row),
+            guard = {.row = plan.num_rows,
                      .col = static_cast<int>(guard_col),
                      .dir_row = -1,
                      .dir_col = 0};
         }
-        n_row++;
+        plan.num_rows++;
     }
-    return std::make_pair(obstructions, guard);
+
+    if (!guard) {
+        throw std::runtime_error("Invalid input: no guard");
+    }
+    return std::make_pair(std::move(plan), *guard);
 }
 
-// std::vector<std::vector<bool>>
-std::optional<std::size_t> walk(guard_pos guard,
-                                const std::vector<std::vector<bool>> &obstructions) {
-    const auto n_rows = obstructions.size();
-    const auto n_cols = obstructions.front().size();
+// For every cell and direction the cell in which the guard stops in front of the next
+// obstruction, or `exit` if the guard walks off the map.
+class jump_table {
+  public:
+    static constexpr int exit = -1;
+    static constexpr int no_obstruction = -1;
 
-    std::vector<std::vector<bool>> visited;
-    for (std::size_t i; i < n_rows; i++) {
-        visited.emplace_back(n_cols);
+    explicit jump_table(const floor_plan &plan)
+        : num_rows(plan.num_rows), num_cols(plan.num_cols),
+          stops(num_directions * plan.num_cells(), exit) {
+        for (int col = 0; col < num_cols; ++col) {
+            // Up
+            for (int row = 0, stop = exit; row < num_rows; ++row) {
+                if (plan.obstructions[plan.cell(row, col)]) {
+                    stop = plan.cell(row + 1, col);
+                } else {
+                    stops[index(plan.cell(row, col), 0)] = stop;
+                }
+            }
+            // Down
+            for (int row = num_rows - 1, stop = exit; row >= 0; --row) {
+                if (plan.obstructions[plan.cell(row, col)]) {
+                    stop = plan.cell(row - 1, col);
+                } else {
+                    stops[index(plan.cell(row, col), 2)] = stop;
+                }
+            }
+        }
+        for (int row = 0; row < num_rows; ++row) {
+            // Left
+            for (int col = 0, stop = exit; col < num_cols; ++col) {
+                if (plan.obstructions[plan.cell(row, col)]) {
+                    stop = plan.cell(row, col + 1);
+                } else {
+                    stops[index(plan.cell(row, col), 3)] = stop;
+                }
+            }
+            // Right
+            for (int col = num_cols - 1, stop = exit; col >= 0; --col) {
+                if (plan.obstructions[plan.cell(row, col)]) {
+                    stop = plan.cell(row, col - 1);
+                } else {
+                    stops[index(plan.cell(row, col), 1)] = stop;
+                }
+            }
+        }
     }
-    visited[guard.row][guard.col] = true;
 
-    std::set<guard_pos> prev_pos;
+    // The table is patched with a single temporary obstruction by checking whether it lies
+    // between `cell` and the precomputed stop, so no entries have to be rewritten.
+    int next_stop(int cell, int dir, int extra = no_obstruction) const {
+        const auto stop = stops[index(cell, dir)];
+        if (extra == no_obstruction) {
+            return stop;
+        }
+        return patch(cell, dir, stop, extra);
+    }
 
-    auto is_valid_pos = [n_rows, n_cols](int row, int col) {
-        return 0 <= row && row < n_rows && 0 <= col && col < n_cols;
-    };
+    // Each additional obstruction can only move the stop closer to `cell`
+    int next_stop(int cell, int dir, std::span<const int> extras) const {
+        auto stop = stops[index(cell, dir)];
+        for (const auto extra : extras) {
+            stop = patch(cell, dir, stop, extra);
+        }
+        return stop;
+    }
 
-    while (true) {
-        guard_pos next = {
-            .row = guard.row + guard.dir_row,
-            .col = guard.col + guard.dir_col,
-            .dir_row = guard.dir_row,
-            .dir_col = guard.dir_col,
-        };
+  private:
+    int num_rows;
+    int num_cols;
+    std::vector<int> stops;
 
-        const auto is_valid = is_valid_pos(next.row, next.col);
-        const auto is_obstruction = obstructions[next.row][next.col];
+    int index(int cell, int dir) const { return cell * num_directions + dir; }
 
-        if (!is_valid) {
-            // Walked off map
+    int patch(int cell, int dir, int stop, int extra) const {
+        const auto row = cell / num_cols;
+        const auto col = cell % num_cols;
+        const auto extra_row = extra / num_cols;
+        const auto extra_col = extra % num_cols;
+        switch (dir) {
+        case 0:
+            if (extra_col == col && extra_row < row && (stop == exit || extra >= stop)) {
+                return extra + num_cols;
+            }
+            break;
+        case 1:
+            if (extra_row == row && extra_col > col && (stop == exit || extra <= stop)) {
+                return extra - 1;
+            }
             break;
+        case 2:
+            if (extra_col == col && extra_row > row && (stop == exit || extra <= stop)) {
+                return extra - num_cols;
+            }
+            break;
+        case 3:
+            if (extra_row == row && extra_col < col && (stop == exit || extra >= stop)) {
+                return extra + 1;
+            }
+            break;
+        }
+        return stop;
+    }
+};
+
+// Dense (cell, direction) bitmap of the turns taken during a walk. Only the words that were
+// touched are reset, so the scratch can be reused across many walks.
+class turn_bitmap {
+  public:
+    explicit turn_bitmap(int num_cells) : bits((num_cells * num_directions + 63) / 64) {}
+
+    // Returns false if the state has been seen before
+    bool insert(int cell, int dir) {
+        const auto bit = static_cast<std::size_t>(cell) * num_directions + dir;
+        auto &word = bits[bit / 64];
+        const auto mask = std::uint64_t{1} << (bit % 64);
+        if (word & mask) {
+            return false;
         }
-        if (is_obstruction) {
-            // Turn
-            const auto new_dir_row = guard.dir_col;
-            const auto new_dir_col = -guard.dir_row;
-            guard.dir_row = new_dir_row;
-            guard.dir_col = new_dir_col;
-            continue;
+        if (word == 0) {
+            touched.push_back(bit / 64);
         }
+        word |= mask;
+        return true;
+    }
 
-        guard = next;
-        visited[guard.row][guard.col] = true;
+    void clear() {
+        for (const auto word : touched) {
+            bits[word] = 0;
+        }
+        touched.clear();
+    }
+
+  private:
+    std::vector<std::uint64_t> bits;
+    std::vector<std::size_t> touched;
+};
+
+bool loops(int cell, int dir, const jump_table &table, int extra, turn_bitmap &turns) {
+    turns.clear();
+    while (true) {
+        const auto stop = table.next_stop(cell, dir, extra);
+        if (stop == jump_table::exit) {
+            return false;
+        }
+        if (!turns.insert(stop, dir)) {
+            return true;
+        }
+        cell = stop;
+        dir = (dir + 1) % num_directions;
+    }
+}
+
+// The guard's state just before it first enters `cell`. Blocking `cell` cannot change anything
+// that happened before, so a trial with an obstruction there can start from this state.
+struct route_step {
+    int cell;
+    int from_cell;
+    int dir;
+};
+
+// Distinct cells of the patrol in order of their first visit, starting with the guard's cell.
+std::optional<std::vector<route_step>> walk(guard_pos guard, const floor_plan &plan,
+                                            const jump_table &table) {
+    std::vector<bool> visited(plan.num_cells());
+    std::vector<route_step> route;
+    turn_bitmap turns(plan.num_cells());
+
+    auto row = guard.row;
+    auto col = guard.col;
+    auto dir = direction_index(guard.dir_row, guard.dir_col);
+    visited[plan.cell(row, col)] = true;
+    route.push_back({.cell = plan.cell(row, col), .from_cell = plan.cell(row, col), .dir = dir});
+
+    while (true) {
+        const auto stop = table.next_stop(plan.cell(row, col), dir);
+
+        // Walk the straight segment up to the stop or the edge of the map
+        while (plan.cell(row, col) != stop) {
+            const auto next_row = row + dir_rows[dir];
+            const auto next_col = col + dir_cols[dir];
+            if (next_row < 0 || next_row >= plan.num_rows || next_col < 0 ||
+                next_col >= plan.num_cols) {
+                break;
+            }
+            const auto next = plan.cell(next_row, next_col);
+            if (!visited[next]) {
+                visited[next] = true;
+                route.push_back({.cell = next, .from_cell = plan.cell(row, col), .dir = dir});
+            }
+            row = next_row;
+            col = next_col;
+        }
+
+        if (stop == jump_table::exit) {
+            // Walked off map
+            break;
+        }
 
         // Loop detection
-        if (prev_pos.find(guard) != prev_pos.cend()) {
+        if (!turns.insert(stop, dir)) {
             return {};
-        } else {
-            prev_pos.insert(guard);
         }
+        dir = (dir + 1) % num_directions;
+    }
+
+    return route;
+}
+
+// Splits [0, n) into one contiguous chunk per hardware thread and runs fn(begin, end) on each
+template <typename Fn> void parallel_chunks(std::size_t n, Fn fn) {
+    const auto num_threads =
+        std::max<std::size_t>(1, std::min<std::size_t>(std::thread::hardware_concurrency(), n));
+    const auto chunk_size = (n + num_threads - 1) / num_threads;
+
+    std::vector<std::jthread> workers;
+    for (std::size_t t = 0; t < num_threads; ++t) {
+        const auto begin = std::min(t * chunk_size, n);
+        const auto end = std::min(begin + chunk_size, n);
+        workers.emplace_back(fn, begin, end);
     }
+}
 
-    std::size_t num_visited = 0;
-    for (const auto &row : visited) {
-        for (const auto col : row) {
-            if (col) {
-                num_visited++;
+// Places an obstruction on every cell of the route (except the guard's start) and counts the
+// ones that trap the guard in a loop. Each thread owns its turn bitmap; the jump table is shared
+// read-only and the obstruction is passed as an overlay.
+std::size_t count_loop_obstructions(const std::vector<route_step> &route, const floor_plan &plan,
+                                    const jump_table &table) {
+    if (route.size() < 2) {
+        return 0;
+    }
+
+    std::atomic<std::size_t> total = 0;
+    parallel_chunks(route.size() - 1, [&](std::size_t begin, std::size_t end) {
+        turn_bitmap turns(plan.num_cells());
+        std::size_t num_loops = 0;
+        for (auto i = begin + 1; i < end + 1; ++i) {
+            const auto &step = route[i];
+            if (loops(step.from_cell, step.dir, table, step.cell, turns)) {
+                ++num_loops;
             }
         }
+        total += num_loops;
+    });
+    return total;
+}
+
+struct guard_state {
+    int cell;
+    int dir;
+};
+
+struct loop_query {
+    guard_state start;
+    std::vector<int> extra_obstructions;
+};
+
+// Per-thread scratch space of a patrol_simulator
+struct walk_scratch {
+    explicit walk_scratch(int num_cells) : turns(num_cells), seen(num_cells) {}
+
+    turn_bitmap turns;
+    std::vector<std::uint8_t> seen;
+    std::vector<guard_state> path;
+};
+
+// Answers guard queries against a floor plan that is preprocessed once. The plan and its jump
+// table are read-only, so batches of queries run concurrently. Results on the unmodified plan
+// are memoized for every guard state on a walked trajectory: visited-cell queries starting on a
+// known trajectory return immediately and loop queries stop as soon as they merge into one.
+class patrol_simulator {
+  public:
+    const floor_plan plan;
+    const jump_table table;
+
+    explicit patrol_simulator(floor_plan floor)
+        : plan(std::move(floor)), table(plan), visited_memo(num_states()),
+          fate_memo(num_states()) {}
+
+    // Number of distinct cells the guard visits from `start`, including a possible loop. A walk
+    // that joins a known trajectory midway cannot stop there: the memo holds the number of distinct
+    // cells of the rest, not the cells, so their overlap with the cells walked so far is unknown.
+    std::size_t cells_visited(guard_state start, walk_scratch &scratch) {
+        validate(start);
+        if (const auto count = visited_memo[state_index(start)].load(std::memory_order_relaxed)) {
+            return count;
+        }
+
+        auto &path = scratch.path;
+        path.clear();
+        scratch.turns.clear();
+
+        std::optional<std::size_t> cycle_start;
+        auto [cell, dir] = start;
+        while (true) {
+            const auto stop = table.next_stop(cell, dir);
+            while (true) {
+                path.push_back({.cell = cell, .dir = dir});
+                if (cell == stop) {
+                    break;
+                }
+                const auto next = step(cell, dir);
+                if (!next) {
+                    break;
+                }
+                cell = *next;
+            }
+
+            if (stop == jump_table::exit) {
+                break;
+            }
+            if (!scratch.turns.insert(stop, dir)) {
+                const auto it = std::find_if(path.cbegin(), path.cend(), [&](const auto &s) {
+                    return s.cell == stop && s.dir == dir;
+                });
+                cycle_start = it - path.cbegin();
+                break;
+            }
+            dir = (dir + 1) % num_directions;
+        }
+
+        // The distinct cells of every suffix of the path, counted backwards. All states of the
+        // cycle see the whole cycle.
+        std::uint32_t count = 0;
+        std::uint32_t cycle_count = 0;
+        for (auto i = path.size(); i-- > 0;) {
+            auto &seen = scratch.seen[path[i].cell];
+            if (!seen) {
+                seen = 1;
+                ++count;
+            }
+            if (i == cycle_start) {
+                cycle_count = count;
+            }
+            if (!cycle_start || i < *cycle_start) {
+                visited_memo[state_index(path[i])].store(count, std::memory_order_relaxed);
+            }
+        }
+        for (auto i = cycle_start.value_or(path.size()); i < path.size(); ++i) {
+            visited_memo[state_index(path[i])].store(cycle_count, std::memory_order_relaxed);
+        }
+        for (const auto &s : path) {
+            scratch.seen[s.cell] = 0;
+        }
+
+        return visited_memo[state_index(start)].load(std::memory_order_relaxed);
     }
 
-    return num_visited;
-}
+    // Whether the guard loops from `start` with additional obstructions. The memoized outcomes
+    // only hold for the unmodified plan, so they are used and updated without extras only.
+    bool loops(guard_state start, std::span<const int> extras, walk_scratch &scratch) {
+        validate(start);
+        if (std::find(extras.begin(), extras.end(), start.cell) != extras.end()) {
+            throw std::runtime_error("Guard starts on an obstruction");
+        }
 
-int main() {
-    auto [obstructions, guard] = read_input(std::cin);
-    const auto num_visited = *walk(guard, obstructions);
-    std::clog << "Part 1: " << num_visited << "\n";
+        const auto use_memo = extras.empty();
+        auto &path = scratch.path;
+        path.clear();
+        scratch.turns.clear();
 
-    std::size_t num_loops = 0;
-    const auto num_rows = obstructions.size();
-    const auto num_cols = obstructions.front().size();
-    for (std::size_t row = 0; row < num_rows; row++) {
-        for (std::size_t col = 0; col < num_cols; col++) {
-            if (row == guard.row && col == guard.col) {
-                continue;
+        auto result = fate::exits;
+        auto [cell, dir] = start;
+        while (true) {
+            const auto stop = table.next_stop(cell, dir, extras);
+            if (stop == jump_table::exit) {
+                result = fate::exits;
+                break;
             }
-            if (obstructions[row][col]) {
-                // Nothing to do
-                continue;
+            if (use_memo) {
+                const auto known =
+                    fate_memo[state_index({stop, dir})].load(std::memory_order_relaxed);
+                if (known != fate::unknown) {
+                    result = known;
+                    break;
+                }
             }
+            if (!scratch.turns.insert(stop, dir)) {
+                result = fate::loops;
+                break;
+            }
+            path.push_back({.cell = stop, .dir = dir});
+            cell = stop;
+            dir = (dir + 1) % num_directions;
+        }
 
-            obstructions[row][col] = true;
-            if (!walk(guard, obstructions)) {
-                num_loops += 1;
+        if (use_memo) {
+            for (const auto &s : path) {
+                fate_memo[state_index(s)].store(result, std::memory_order_relaxed);
             }
-            obstructions[row][col] = false;
         }
+        return result == fate::loops;
     }
 
+    std::size_t cells_visited(guard_state start) {
+        walk_scratch scratch(plan.num_cells());
+        return cells_visited(start, scratch);
+    }
+
+    std::vector<std::size_t> cells_visited(std::span<const guard_state> starts) {
+        std::for_each(starts.begin(), starts.end(), [this](const auto &s) { validate(s); });
+
+        std::vector<std::size_t> results(starts.size());
+        parallel_chunks(starts.size(), [&](std::size_t begin, std::size_t end) {
+            walk_scratch scratch(plan.num_cells());
+            for (auto i = begin; i < end; ++i) {
+                results[i] = cells_visited(starts[i], scratch);
+            }
+        });
+        return results;
+    }
+
+    std::vector<std::uint8_t> loops(std::span<const loop_query> queries) {
+        for (const auto &q : queries) {
+            validate(q.start);
+            for (const auto extra : q.extra_obstructions) {
+                if (extra < 0 || extra >= plan.num_cells() || extra == q.start.cell) {
+                    throw std::out_of_range("Invalid extra obstruction");
+                }
+            }
+        }
+
+        std::vector<std::uint8_t> results(queries.size());
+        parallel_chunks(queries.size(), [&](std::size_t begin, std::size_t end) {
+            walk_scratch scratch(plan.num_cells());
+            for (auto i = begin; i < end; ++i) {
+                results[i] = loops(queries[i].start, queries[i].extra_obstructions, scratch);
+            }
+        });
+        return results;
+    }
+
+  private:
+    enum class fate : std::uint8_t { unknown, exits, loops };
+
+    std::vector<std::atomic<std::uint32_t>> visited_memo; // 0 if unknown
+    std::vector<std::atomic<fate>> fate_memo;
+
+    std::size_t num_states() const {
+        return static_cast<std::size_t>(plan.num_cells()) * num_directions;
+    }
+    std::size_t state_index(guard_state s) const {
+        return static_cast<std::size_t>(s.cell) * num_directions + s.dir;
+    }
+
+    void validate(guard_state s) const {
+        if (s.cell < 0 || s.cell >= plan.num_cells() || s.dir < 0 || s.dir >= num_directions) {
+            throw std::out_of_range("Invalid guard state");
+        }
+        if (plan.obstructions[s.cell]) {
+            throw std::runtime_error("Guard starts on an obstruction");
+        }
+    }
+
+    std::optional<int> step(int cell, int dir) const {
+        const auto row = cell / plan.num_cols + dir_rows[dir];
+        const auto col = cell % plan.num_cols + dir_cols[dir];
+        if (row < 0 || row >= plan.num_rows || col < 0 || col >= plan.num_cols) {
+            return {};
+        }
+        return plan.cell(row, col);
+    }
+};
+
+int main() {
+    auto [plan, guard] = read_input(std::cin);
+    patrol_simulator sim(std::move(plan));
+
+    const auto route = walk(guard, sim.plan, sim.table);
+    if (!route) {
+        throw std::runtime_error("Guard is stuck in a loop");
+    }
+    const guard_state start = {.cell = sim.plan.cell(guard.row, guard.col),
+                               .dir = direction_index(guard.dir_row, guard.dir_col)};
+    std::clog << "Part 1: " << sim.cells_visited(start) << "\n";
+
+    const auto t0 = std::chrono::steady_clock::now();
+    const auto num_loops = count_loop_obstructions(*route, sim.plan, sim.table);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - t0;
+
     std::clog << "Part 2: " << num_loops << "\n";
 
+    const auto num_trials = route->size() - 1;
+    std::clog << "Trials: " << num_trials << " (" << num_trials / elapsed.count()
+              << " trials/s)\n";
+
     return 0;
 }
@@ -1,27 +1,82 @@
 #include <absl/strings/str_split.h>
-#include <cmath>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <exception>
 #include <iostream>
 #include <iterator>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 using IntType = long long;
+using WideIntType = __int128;
 
 struct equation {
-    IntType result;
-    std::vector<IntType> operands;
+    WideIntType result;
+    std::vector<WideIntType> operands;
 };
 
+WideIntType parse_int(std::string_view str) {
+    const bool negative = !str.empty() && str.front() == '-';
+    if (negative) {
+        str.remove_prefix(1);
+    }
+    if (str.empty()) {
+        throw std::invalid_argument("Invalid integer");
+    }
+
+    WideIntType value = 0;
+    for (const auto c : str) {
+        if (c < '0' || c > '9') {
+            throw std::invalid_argument("Invalid integer");
+        }
+        if (__builtin_mul_overflow(value, 10, &value) ||
+            __builtin_sub_overflow(value, c - '0', &value)) {
+            throw std::out_of_range("Integer does not fit into 128 bits");
+        }
+    }
+    if (!negative && __builtin_mul_overflow(value, -1, &value)) {
+        throw std::out_of_range("Integer does not fit into 128 bits");
+    }
+    return value;
+}
+
+std::string to_string(WideIntType value) {
+    if (value == 0) {
+        return "0";
+    }
+    const bool negative = value < 0;
+    std::string str;
+    while (value != 0) {
+        const auto digit = static_cast<int>(value % 10);
+        str.push_back('0' + (negative ? -digit : digit));
+        value /= 10;
+    }
+    if (negative) {
+        str.push_back('-');
+    }
+    std::reverse(str.begin(), str.end());
+    return str;
+}
+
 std::vector<equation> read_input(std::istream &istream) {
     std::vector<equation> equations;
 
     std::string line;
     while (istream && std::getline(istream, line)) {
         std::pair<std::string, std::string> split = absl::StrSplit(line, ": ");
-        const auto result = std::stoll(split.first);
+        const auto result = parse_int(split.first);
 
         std::vector<std::string> operands_str = absl::StrSplit(split.second, " ");
-        std::vector<IntType> operands;
+        std::vector<WideIntType> operands;
         std::transform(operands_str.cbegin(), operands_str.cend(), std::back_inserter(operands),
-                       [](auto elem) { return std::stoll(elem); });
+                       [](const auto &elem) { return parse_int(elem); });
 
         equations.push_back({.result = result, .operands = std::move(operands)});
     }
@@ -29,70 +84,315 @@ std::vector<equation> read_input(std::istream &istream) {
     return equations;
 }
 
-IntType concat_op(IntType lhs, IntType rhs) {
-    std::size_t num_digits = 0;
-    auto rhs_copy = rhs;
-    while (rhs_copy >= 1) {
-        rhs_copy /= 10;
-        num_digits++;
+// powers<Int, Base>[d] == Base^d for every power of Base representable in Int
+template <typename Int, unsigned Base>
+constexpr auto powers = [] {
+    constexpr auto size = [] {
+        std::size_t n = 1;
+        for (Int power = 1; power <= std::numeric_limits<Int>::max() / Base; power *= Base) {
+            ++n;
+        }
+        return n;
+    }();
+
+    std::array<Int, size> table{};
+    Int power = 1;
+    for (std::size_t d = 0; d < table.size(); ++d) {
+        table[d] = power;
+        if (d + 1 < table.size()) {
+            power *= Base;
+        }
     }
-    return lhs * std::pow(10, num_digits) + rhs;
+    return table;
+}();
+
+// Number of base-`Base` digits of a positive number, one past the table for numbers larger than
+// the largest representable power
+template <typename Int, unsigned Base> std::size_t get_num_digits(Int num) {
+    const auto &table = powers<Int, Base>;
+    return std::upper_bound(table.cbegin(), table.cend(), num) - table.cbegin();
 }
 
-bool eq_ok_rec(const IntType result, const IntType acc, std::vector<IntType>::const_iterator start,
-               std::vector<IntType>::const_iterator end) {
-    if (start == end) {
-        return result == acc;
+// The left hand sides that solve `lhs op rhs == result`: none, exactly one or any value. Overflow
+// means the left hand side exists but does not fit into Int.
+template <typename Int> struct inverse {
+    enum { none, one, any, overflow } kind;
+    Int lhs = 0;
+};
+
+// Operators are evaluated left to right. For the backwards search each one provides its inverse
+// and whether it maps non-negative operands to a non-negative value, which allows pruning
+// negative intermediate results.
+struct add {
+    static constexpr bool keeps_non_negative = true;
+
+    template <typename Int> static inverse<Int> invert(Int result, Int rhs) {
+        Int lhs;
+        if (__builtin_sub_overflow(result, rhs, &lhs)) {
+            return {.kind = inverse<Int>::overflow};
+        }
+        return {.kind = inverse<Int>::one, .lhs = lhs};
+    }
+};
+
+struct subtract {
+    static constexpr bool keeps_non_negative = false;
+
+    template <typename Int> static inverse<Int> invert(Int result, Int rhs) {
+        Int lhs;
+        if (__builtin_add_overflow(result, rhs, &lhs)) {
+            return {.kind = inverse<Int>::overflow};
+        }
+        return {.kind = inverse<Int>::one, .lhs = lhs};
     }
+};
+
+struct multiply {
+    static constexpr bool keeps_non_negative = true;
+
+    template <typename Int> static inverse<Int> invert(Int result, Int rhs) {
+        if (rhs == 0) {
+            return {.kind = result == 0 ? inverse<Int>::any : inverse<Int>::none};
+        }
+        if (rhs == -1 && result == std::numeric_limits<Int>::min()) {
+            return {.kind = inverse<Int>::overflow};
+        }
+        if (result % rhs != 0) {
+            return {.kind = inverse<Int>::none};
+        }
+        return {.kind = inverse<Int>::one, .lhs = result / rhs};
+    }
+};
+
+struct bitwise_xor {
+    static constexpr bool keeps_non_negative = true;
+
+    template <typename Int> static inverse<Int> invert(Int result, Int rhs) {
+        return {.kind = inverse<Int>::one, .lhs = result ^ rhs};
+    }
+};
 
-    const IntType acc_plus = acc + *start;
-    const IntType acc_mult = acc * *start;
+// Appends the base-`Base` digits of rhs to lhs. A non-positive rhs has no digits and is simply
+// added.
+template <unsigned Base> struct concatenate {
+    static_assert(Base >= 2);
+    static constexpr bool keeps_non_negative = true;
 
-    return eq_ok_rec(result, acc_plus, start + 1, end) ||
-           eq_ok_rec(result, acc_mult, start + 1, end);
+    template <typename Int> static inverse<Int> invert(Int result, Int rhs) {
+        if (rhs <= 0) {
+            return add::invert(result, rhs);
+        }
+
+        Int diff;
+        if (__builtin_sub_overflow(result, rhs, &diff)) {
+            return {.kind = inverse<Int>::overflow};
+        }
+        const auto num_digits = get_num_digits<Int, Base>(rhs);
+        if (num_digits >= powers<Int, Base>.size()) {
+            // Only lhs == 0 does not overflow
+            return {.kind = diff == 0 ? inverse<Int>::one : inverse<Int>::overflow};
+        }
+        const auto power = powers<Int, Base>[num_digits];
+        if (diff % power != 0) {
+            return {.kind = inverse<Int>::none};
+        }
+        return {.kind = inverse<Int>::one, .lhs = diff / power};
+    }
+};
+
+// Saturates at the maximum instead of wrapping around
+std::uint64_t saturating_add(std::uint64_t lhs, std::uint64_t rhs) {
+    std::uint64_t sum;
+    return __builtin_add_overflow(lhs, rhs, &sum) ? std::numeric_limits<std::uint64_t>::max() : sum;
 }
 
-bool eq_ok_with_concat_rec(const IntType result, const IntType acc,
-                           std::vector<IntType>::const_iterator start,
-                           std::vector<IntType>::const_iterator end) {
-    if (start == end) {
-        return result == acc;
+// A set of operators fixed at compile time. The backwards search works from the result: the last
+// operand is removed with the inverse of every operator and branches without an inverse are
+// pruned. The operators are expanded with fold expressions, so there is no indirect call per node.
+// Branches whose inverse does not fit into Int are pruned as well, but set `overflowed`.
+template <typename... Ops> struct operator_set {
+    static constexpr bool keeps_non_negative = (Ops::keeps_non_negative && ...);
+
+    template <typename Int>
+    static bool solvable(Int result, std::span<const Int> operands, bool prune_negative,
+                         bool &overflowed) {
+        const auto last = operands.back();
+        if (operands.size() == 1) {
+            return result == last;
+        }
+        const auto rest = operands.first(operands.size() - 1);
+
+        auto try_op = [&]<typename Op>() {
+            const auto inv = Op::invert(result, last);
+            switch (inv.kind) {
+            case inverse<Int>::none:
+                return false;
+            case inverse<Int>::overflow:
+                overflowed = true;
+                return false;
+            case inverse<Int>::any:
+                return true;
+            case inverse<Int>::one:
+                return !(prune_negative && inv.lhs < 0) &&
+                       solvable(inv.lhs, rest, prune_negative, overflowed);
+            }
+            return false;
+        };
+        return (try_op.template operator()<Ops>() || ...);
+    }
+
+    // Number of operator assignments that produce the result
+    template <typename Int>
+    static std::uint64_t count(Int result, std::span<const Int> operands, bool prune_negative,
+                               bool &overflowed) {
+        const auto last = operands.back();
+        if (operands.size() == 1) {
+            return result == last;
+        }
+        const auto rest = operands.first(operands.size() - 1);
+
+        std::uint64_t total = 0;
+        auto count_op = [&]<typename Op>() {
+            const auto inv = Op::invert(result, last);
+            if (inv.kind == inverse<Int>::overflow) {
+                overflowed = true;
+            } else if (inv.kind == inverse<Int>::any) {
+                total = saturating_add(total, num_assignments(rest.size()));
+            } else if (inv.kind == inverse<Int>::one && !(prune_negative && inv.lhs < 0)) {
+                total = saturating_add(total, count(inv.lhs, rest, prune_negative, overflowed));
+            }
+        };
+        (count_op.template operator()<Ops>(), ...);
+        return total;
+    }
+
+    static std::uint64_t num_assignments(std::size_t num_operands) {
+        std::uint64_t total = 1;
+        for (std::size_t i = 1; i < num_operands; ++i) {
+            if (__builtin_mul_overflow(total, sizeof...(Ops), &total)) {
+                return std::numeric_limits<std::uint64_t>::max();
+            }
+        }
+        return total;
+    }
+};
+
+struct solution {
+    bool ok;
+    std::uint64_t num_assignments; // Saturates at the maximum of std::uint64_t
+};
+
+// `overflowed` is set when a pruned branch might have led to further solutions in a wider type
+template <typename OpSet, typename Int>
+solution solve(Int result, std::span<const Int> operands, bool with_count, bool &overflowed) {
+    const auto prune_negative =
+        OpSet::keeps_non_negative && result >= 0 &&
+        std::all_of(operands.begin(), operands.end(), [](Int x) { return x >= 0; });
+    if (with_count) {
+        const auto num_assignments = OpSet::count(result, operands, prune_negative, overflowed);
+        return {.ok = num_assignments > 0, .num_assignments = num_assignments};
     }
+    const auto ok = OpSet::solvable(result, operands, prune_negative, overflowed);
+    // A solution is final, the overflowed branches do not matter then
+    overflowed = overflowed && !ok;
+    return {.ok = ok, .num_assignments = 0};
+}
 
-    const IntType acc_plus = acc + *start;
-    const IntType acc_mult = acc * *start;
-    const IntType acc_concat = concat_op(acc, *start);
+// Solves with 64-bit arithmetic when all values fit and no intermediate value overflows, falling
+// back to 128 bits otherwise. Intermediate values beyond 128 bits are not searched. `narrow` is
+// scratch space for the narrowed operands.
+template <typename OpSet>
+solution solve(const equation &eq, bool with_count, std::vector<IntType> &narrow) {
+    if (eq.operands.empty()) {
+        throw std::runtime_error("Equation without operands");
+    }
 
-    return eq_ok_with_concat_rec(result, acc_plus, start + 1, end) ||
-           eq_ok_with_concat_rec(result, acc_mult, start + 1, end) ||
-           eq_ok_with_concat_rec(result, acc_concat, start + 1, end);
+    auto fits = [](WideIntType x) {
+        return std::numeric_limits<IntType>::min() <= x && x <= std::numeric_limits<IntType>::max();
+    };
+    if (fits(eq.result) && std::all_of(eq.operands.cbegin(), eq.operands.cend(), fits)) {
+        narrow.assign(eq.operands.cbegin(), eq.operands.cend());
+        bool overflowed = false;
+        const auto narrow_solution =
+            solve<OpSet, IntType>(static_cast<IntType>(eq.result), narrow, with_count, overflowed);
+        if (!overflowed) {
+            return narrow_solution;
+        }
+    }
+    bool overflowed = false;
+    return solve<OpSet, WideIntType>(eq.result, eq.operands, with_count, overflowed);
 }
 
-bool eq_ok(const equation &eq) {
-    return eq_ok_rec(eq.result, eq.operands.front(), eq.operands.cbegin() + 1, eq.operands.cend());
+// Worker threads take batches of equations from a shared counter until all are solved
+template <typename OpSet>
+std::vector<solution> solve_batched(const std::vector<equation> &equations, bool with_count,
+                                    std::size_t batch_size = 64) {
+    std::vector<solution> solutions(equations.size());
+    const auto num_batches = (equations.size() + batch_size - 1) / batch_size;
+    const auto num_threads = std::max<std::size_t>(
+        1, std::min<std::size_t>(std::thread::hardware_concurrency(), num_batches));
+
+    std::atomic<std::size_t> next_batch = 0;
+    std::vector<std::exception_ptr> errors(num_threads);
+    {
+        std::vector<std::jthread> workers;
+        for (std::size_t t = 0; t < num_threads; ++t) {
+            workers.emplace_back([&, t]() {
+                try {
+                    std::vector<IntType> narrow;
+                    for (auto batch = next_batch++; batch < num_batches; batch = next_batch++) {
+                        const auto begin = batch * batch_size;
+                        const auto end = std::min(begin + batch_size, equations.size());
+                        for (auto i = begin; i < end; ++i) {
+                            solutions[i] = solve<OpSet>(equations[i], with_count, narrow);
+                        }
+                    }
+                } catch (...) {
+                    errors[t] = std::current_exception();
+                }
+            });
+        }
+    }
+
+    for (const auto &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    return solutions;
 }
 
-bool eq_ok_with_concat(const equation &eq) {
-    return eq_ok_with_concat_rec(eq.result, eq.operands.front(), eq.operands.cbegin() + 1,
-                                 eq.operands.cend());
+WideIntType sum_solvable(const std::vector<equation> &equations,
+                         const std::vector<solution> &solutions) {
+    WideIntType total = 0;
+    for (std::size_t i = 0; i < equations.size(); ++i) {
+        if (solutions[i].ok && __builtin_add_overflow(total, equations[i].result, &total)) {
+            throw std::overflow_error("Total does not fit into 128 bits");
+        }
+    }
+    return total;
 }
 
-int main() {
+using basic_operators = operator_set<add, multiply>;
+using concat_operators = operator_set<add, multiply, concatenate<10>>;
+
+int main(int argc, char *argv[]) {
+    // --counts prints the number of valid operator assignments of every equation
+    const bool with_count = argc > 1 && std::string_view(argv[1]) == "--counts";
+
     const auto equations = read_input(std::cin);
+    const auto solutions_pt1 = solve_batched<basic_operators>(equations, with_count);
+    const auto solutions_pt2 = solve_batched<concat_operators>(equations, with_count);
 
-    long total_pt1 = 0;
-    long total_pt2 = 0;
-    for (const auto &eq : equations) {
-        if (eq_ok(eq)) {
-            total_pt1 += eq.result;
-        }
-        if (eq_ok_with_concat(eq)) {
-            total_pt2 += eq.result;
+    if (with_count) {
+        for (std::size_t i = 0; i < equations.size(); ++i) {
+            std::cout << to_string(equations[i].result) << ": " << solutions_pt1[i].num_assignments
+                      << " " << solutions_pt2[i].num_assignments << "\n";
         }
     }
 
-    std::clog << "Part 1: " << total_pt1 << "\n";
-    std::clog << "Part 2: " << total_pt2 << "\n";
+    std::clog << "Part 1: " << to_string(sum_solvable(equations, solutions_pt1)) << "\n";
+    std::clog << "Part 2: " << to_string(sum_solvable(equations, solutions_pt2)) << "\n";
 
     return 0;
 }
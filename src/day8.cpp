@@ -1,7 +1,14 @@
-#include <functional>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
 #include <iostream>
-#include <map>
-#include <set>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 struct antenna {
@@ -10,8 +17,6 @@ struct antenna {
     char frequency;
 };
 
-using antinode = antenna;
-
 std::tuple<std::vector<antenna>, int, int> read_input(std::istream &istream) {
     std::vector<antenna> antennas;
     int row = 0;
@@ -34,92 +39,225 @@ std::tuple<std::vector<antenna>, int, int> read_input(std::istream &istream) {
     return std::make_tuple(antennas, row, col);
 }
 
-std::map<char, std::vector<antenna>>
-group_antenna_by_frequency(const std::vector<antenna> &antennas) {
-    std::map<char, std::vector<antenna>> antennas_by_frequency;
-    for (const auto &antenna : antennas) {
-        antennas_by_frequency[antenna.frequency].push_back(antenna);
+// Antenna positions sorted by frequency, group i is [offsets[i], offsets[i + 1])
+struct frequency_groups {
+    std::vector<char> frequencies;
+    std::vector<std::size_t> offsets;
+    std::vector<int> rows;
+    std::vector<int> cols;
+
+    std::size_t size() const { return frequencies.size(); }
+};
+
+frequency_groups group_antenna_by_frequency(const std::vector<antenna> &antennas) {
+    constexpr auto num_chars = std::numeric_limits<unsigned char>::max() + 1;
+    std::array<std::size_t, num_chars + 1> bucket_offsets{};
+    for (const auto &a : antennas) {
+        ++bucket_offsets[static_cast<unsigned char>(a.frequency) + 1];
     }
-    return antennas_by_frequency;
+    std::partial_sum(bucket_offsets.cbegin(), bucket_offsets.cend(), bucket_offsets.begin());
+
+    frequency_groups groups;
+    for (std::size_t c = 0; c < num_chars; ++c) {
+        if (bucket_offsets[c] != bucket_offsets[c + 1]) {
+            groups.frequencies.push_back(static_cast<char>(c));
+            groups.offsets.push_back(bucket_offsets[c]);
+        }
+    }
+    groups.offsets.push_back(antennas.size());
+
+    groups.rows.resize(antennas.size());
+    groups.cols.resize(antennas.size());
+    for (const auto &a : antennas) {
+        const auto i = bucket_offsets[static_cast<unsigned char>(a.frequency)]++;
+        groups.rows[i] = a.row;
+        groups.cols[i] = a.col;
+    }
+    return groups;
 }
 
-antinode get_antinode(const antenna &a, const antenna &b) {
-    if (a.frequency != b.frequency) {
-        throw std::runtime_error("called get_antinodes on antennas with different frequencies");
+class bit_grid {
+  public:
+    bit_grid(int num_rows, int num_cols)
+        : num_cols(num_cols), bits((static_cast<std::size_t>(num_rows) * num_cols + 63) / 64) {}
+
+    void set(int row, int col) {
+        const auto i = static_cast<std::size_t>(row) * num_cols + col;
+        bits[i / 64] |= std::uint64_t{1} << (i % 64);
     }
 
-    const auto delta_row = b.row - a.row;
-    const auto delta_col = b.col - a.col;
+    std::size_t count() const {
+        std::size_t total = 0;
+        for (const auto word : bits) {
+            total += std::popcount(word);
+        }
+        return total;
+    }
 
-    return {
-        .row = b.row + delta_row,
-        .col = b.col + delta_col,
-        .frequency = b.frequency,
-    };
-}
+  private:
+    int num_cols;
+    std::vector<std::uint64_t> bits;
+};
 
-std::vector<antinode> get_antinodes_pt2(const antenna &a, const antenna &b,
-                                        std::function<bool(int, int)> f_valid_loc) {
-    if (a.frequency != b.frequency) {
-        throw std::runtime_error("called get_antinodes on antennas with different frequencies");
+// Largest k >= 0 such that pos + k * delta stays within [0, size) for a pos within it
+int max_steps(int pos, int delta, int size) {
+    if (delta > 0) {
+        return (size - 1 - pos) / delta;
+    }
+    if (delta < 0) {
+        return pos / -delta;
     }
+    return std::numeric_limits<int>::max();
+}
 
-    const auto delta_row = b.row - a.row;
-    const auto delta_col = b.col - a.col;
+// Calls mark(row, col) for every antinode of the antenna pair (a, b) inside the map. Part 1 only
+// has the two antinodes at twice the distance, part 2 every grid point on the line through both
+// antennas: the step between them is reduced by its gcd.
+template <typename Mark>
+void mark_antinodes(int a_row, int a_col, int b_row, int b_col, int num_rows, int num_cols,
+                    bool resonant, Mark &&mark) {
+    auto delta_row = b_row - a_row;
+    auto delta_col = b_col - a_col;
 
-    std::vector<antinode> antinodes;
+    if (!resonant) {
+        auto mark_if_valid = [&](int row, int col) {
+            if (0 <= row && row < num_rows && 0 <= col && col < num_cols) {
+                mark(row, col);
+            }
+        };
+        mark_if_valid(b_row + delta_row, b_col + delta_col);
+        mark_if_valid(a_row - delta_row, a_col - delta_col);
+        return;
+    }
 
-    int row = b.row;
-    int col = b.col;
-    while (f_valid_loc(row, col)) {
-        antinodes.push_back({
-            .row = row,
-            .col = col,
-            .frequency = b.frequency,
-        });
+    const auto divisor = std::gcd(delta_row, delta_col);
+    delta_row /= divisor;
+    delta_col /= divisor;
 
-        row += delta_row;
-        col += delta_col;
+    const auto forward = std::min(max_steps(a_row, delta_row, num_rows),
+                                  max_steps(a_col, delta_col, num_cols));
+    const auto backward = std::min(max_steps(a_row, -delta_row, num_rows),
+                                   max_steps(a_col, -delta_col, num_cols));
+    for (int k = -backward; k <= forward; ++k) {
+        mark(a_row + k * delta_row, a_col + k * delta_col);
     }
+}
 
-    return antinodes;
+std::size_t count_antinodes(const frequency_groups &groups, int num_rows, int num_cols,
+                            bool resonant) {
+    bit_grid antinodes(num_rows, num_cols);
+    auto mark = [&antinodes](int row, int col) { antinodes.set(row, col); };
+
+    for (std::size_t g = 0; g < groups.size(); ++g) {
+        // All antenna pairs
+        for (auto i = groups.offsets[g]; i < groups.offsets[g + 1]; ++i) {
+            for (auto j = i + 1; j < groups.offsets[g + 1]; ++j) {
+                mark_antinodes(groups.rows[i], groups.cols[i], groups.rows[j], groups.cols[j],
+                               num_rows, num_cols, resonant, mark);
+            }
+        }
+    }
+    return antinodes.count();
 }
 
-int main() {
-    const auto [antennas, num_rows, num_cols] = read_input(std::cin);
-    const auto antennas_by_frequency = group_antenna_by_frequency(antennas);
+// Beyond this many cells the bitmap gets too large and the sparse mode is used
+constexpr std::size_t max_dense_cells = std::size_t{1} << 28;
 
-    auto is_valid_location = [num_rows, num_cols](int row, int col) {
-        return 0 <= row && row < num_rows && 0 <= col && col < num_cols;
+// Sparse mode for large maps: frequencies are processed in parallel and every thread appends the
+// antinodes as cell indices to its own buffers, one per shard of rows. Each shard is then merged
+// across threads and deduplicated by sorting, so the cost depends on the number of antinodes
+// instead of the area of the map.
+std::size_t count_antinodes_sparse(const frequency_groups &groups, int num_rows, int num_cols,
+                                   bool resonant) {
+    const auto num_threads = std::max<std::size_t>(
+        1, std::min<std::size_t>(std::thread::hardware_concurrency(), groups.size()));
+    const auto num_shards = 4 * num_threads;
+
+    // Largest groups first to balance the load
+    std::vector<std::size_t> order(groups.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&groups](auto lhs, auto rhs) {
+        return groups.offsets[lhs + 1] - groups.offsets[lhs] >
+               groups.offsets[rhs + 1] - groups.offsets[rhs];
+    });
+
+    using shard = std::vector<std::uint64_t>;
+    std::vector<std::vector<shard>> buffers(num_threads, std::vector<shard>(num_shards));
+
+    // Sorting and deduplicating a buffer whenever it doubled in size bounds the memory by the
+    // number of distinct antinodes per thread
+    auto compact = [](shard &buffer) {
+        std::sort(buffer.begin(), buffer.end());
+        buffer.erase(std::unique(buffer.begin(), buffer.end()), buffer.end());
     };
 
-    std::set<std::pair<int, int>> antinode_locations_pt1;
-    std::set<std::pair<int, int>> antinode_locations_pt2;
-    for (const auto &[frequency, antennas] : antennas_by_frequency) {
-        // All antenna pairs
-        for (const auto &a : antennas) {
-            for (const auto &b : antennas) {
-                if (&a == &b) {
-                    continue;
-                }
+    std::atomic<std::size_t> next_group = 0;
+    {
+        std::vector<std::jthread> workers;
+        for (std::size_t t = 0; t < num_threads; ++t) {
+            workers.emplace_back([&, t]() {
+                auto &local = buffers[t];
+                std::vector<std::size_t> compacted_size(num_shards);
+                auto mark = [&](int row, int col) {
+                    const auto s = static_cast<std::size_t>(row) * num_shards / num_rows;
+                    local[s].push_back(static_cast<std::uint64_t>(row) * num_cols + col);
+                };
 
-                // Part 1
-                const auto antinode = get_antinode(a, b);
-                if (is_valid_location(antinode.row, antinode.col)) {
-                    antinode_locations_pt1.emplace(antinode.row, antinode.col);
+                for (auto n = next_group++; n < groups.size(); n = next_group++) {
+                    const auto g = order[n];
+                    for (auto i = groups.offsets[g]; i < groups.offsets[g + 1]; ++i) {
+                        for (auto j = i + 1; j < groups.offsets[g + 1]; ++j) {
+                            mark_antinodes(groups.rows[i], groups.cols[i], groups.rows[j],
+                                           groups.cols[j], num_rows, num_cols, resonant, mark);
+                        }
+                    }
+                    for (std::size_t s = 0; s < num_shards; ++s) {
+                        const auto limit = std::max<std::size_t>(2 * compacted_size[s], 1 << 16);
+                        if (local[s].size() > limit) {
+                            compact(local[s]);
+                            compacted_size[s] = local[s].size();
+                        }
+                    }
                 }
+            });
+        }
+    }
 
-                // Part 2
-                const auto antinodes = get_antinodes_pt2(a, b, is_valid_location);
-                for (const auto &an : antinodes) {
-                    antinode_locations_pt2.emplace(an.row, an.col);
+    std::atomic<std::size_t> total = 0;
+    std::atomic<std::size_t> next_shard = 0;
+    {
+        std::vector<std::jthread> workers;
+        for (std::size_t t = 0; t < num_threads; ++t) {
+            workers.emplace_back([&]() {
+                for (auto s = next_shard++; s < num_shards; s = next_shard++) {
+                    shard merged;
+                    for (auto &local : buffers) {
+                        merged.insert(merged.end(), local[s].cbegin(), local[s].cend());
+                        shard().swap(local[s]);
+                    }
+                    compact(merged);
+                    total += merged.size();
                 }
-            }
+            });
         }
     }
+    return total;
+}
+
+int main() {
+    const auto [antennas, num_rows, num_cols] = read_input(std::cin);
+    const auto antennas_by_frequency = group_antenna_by_frequency(antennas);
+
+    const auto dense = static_cast<std::size_t>(num_rows) * num_cols <= max_dense_cells;
+    auto count = [&](bool resonant) {
+        if (dense) {
+            return count_antinodes(antennas_by_frequency, num_rows, num_cols, resonant);
+        }
+        return count_antinodes_sparse(antennas_by_frequency, num_rows, num_cols, resonant);
+    };
 
-    std::clog << "Part 1: " << antinode_locations_pt1.size() << "\n";
-    std::clog << "Part 2: " << antinode_locations_pt2.size() << "\n";
+    std::clog << "Part 1: " << count(false) << "\n";
+    std::clog << "Part 2: " << count(true) << "\n";
 
     return 0;
 }
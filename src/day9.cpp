@@ -1,6 +1,8 @@
 #include <algorithm>
+#include <array>
+#include <functional>
 #include <iostream>
-#include <numeric>
+#include <queue>
 #include <string>
 #include <vector>
 
@@ -17,91 +19,115 @@ std::vector<int> read_input(std::istream &istream) {
     return v;
 }
 
-struct block {
-    std::size_t file_id;
-    bool free;
-};
-
-void print_blocks(const std::vector<block> &blocks) {
-    for (const auto &block : blocks) {
-        if (block.free) {
-            std::clog << ".";
-        } else {
-            std::clog << block.file_id;
-        }
-    }
-    std::clog << "\n";
+// Checksums of disks with billions of blocks exceed 64 bits
+using ChecksumType = unsigned __int128;
+
+std::string to_string(ChecksumType value) {
+    std::string str;
+    do {
+        str.push_back(static_cast<char>('0' + value % 10));
+        value /= 10;
+    } while (value != 0);
+    std::reverse(str.begin(), str.end());
+    return str;
 }
 
-std::vector<block> disk_map_to_blocks(const std::vector<int> &disk_map) {
-    const auto num_files = disk_map.size() / 2;
-    const auto total_size =
-        std::accumulate(disk_map.cbegin(), disk_map.cend(), static_cast<std::size_t>(0));
-
-    std::vector<block> blocks;
-    blocks.reserve(total_size);
-
-    bool is_file = true;
-    std::size_t file_id = 0;
-    for (const auto num_blocks : disk_map) {
-        if (is_file) {
-            for (std::size_t i = 0; i < num_blocks; ++i) {
-                blocks.push_back({
-                    .file_id = file_id,
-                    .free = false,
-                });
-            }
-            ++file_id;
-        } else {
-            for (std::size_t i = 0; i < num_blocks; ++i) {
-                blocks.push_back({
-                    .file_id = 0,
-                    .free = true,
-                });
-            }
-        }
-        // Alternate between file and free
-        is_file = !is_file;
+// Checksum contribution of `length` blocks of a file starting at `position`
+ChecksumType extent_checksum(std::size_t file_id, std::size_t position, std::size_t length) {
+    // Sum of the arithmetic series position, ..., position + length - 1
+    return static_cast<ChecksumType>(file_id) *
+           (static_cast<ChecksumType>(length) * position + length * (length - 1) / 2);
+}
+
+// Moves file blocks from the back into the free gaps at the front one extent at a time and
+// accumulates the checksum on the way, without expanding the disk map into blocks
+ChecksumType compact_disk_checksum(const std::vector<int> &disk_map) {
+    if (disk_map.empty()) {
+        return 0;
     }
 
-    return blocks;
-}
+    // File being moved from the back and its blocks that have not been moved yet
+    std::size_t back = (disk_map.size() - 1) / 2;
+    std::size_t back_remaining = disk_map[2 * back];
 
-std::vector<block> compact_disk(std::vector<block> blocks) {
-    std::size_t i = 0, j = blocks.size() - 1;
-    while (i < j) {
-        // Find first free
-        while (!blocks[i].free) {
-            ++i;
+    ChecksumType total = 0;
+    std::size_t position = 0;
+    for (std::size_t front = 0; front <= back; ++front) {
+        const std::size_t length = front == back ? back_remaining : disk_map[2 * front];
+        total += extent_checksum(front, position, length);
+        position += length;
+        if (front == back) {
+            break;
         }
-        // Find first non-free from back
-        while (blocks[j].free) {
-            --j;
-        }
-        if (i < j) {
-            std::swap(blocks[i], blocks[j]);
+
+        // Fill the gap after the file from the back
+        std::size_t gap = disk_map[2 * front + 1];
+        while (gap > 0 && back > front) {
+            const auto moved = std::min(gap, back_remaining);
+            total += extent_checksum(back, position, moved);
+            position += moved;
+            gap -= moved;
+            back_remaining -= moved;
+            if (back_remaining == 0) {
+                --back;
+                back_remaining = disk_map[2 * back];
+            }
         }
     }
-    return blocks;
+    return total;
 }
 
-std::size_t checksum(const std::vector<block> &blocks) {
-    std::size_t total = 0;
-    for (std::size_t i = 0; i < blocks.size(); ++i) {
-        if (!blocks[i].free) {
-            total += i * blocks[i].file_id;
+// Moves every file once, starting from the highest ID, into the leftmost gap that fits it. The
+// gaps are kept in one min-heap of start positions per gap size, so the leftmost gap that fits is
+// the smallest top of the heaps for sizes >= the file size.
+ChecksumType compact_files_checksum(const std::vector<int> &disk_map) {
+    constexpr std::size_t max_gap = 9;
+    using min_heap =
+        std::priority_queue<std::size_t, std::vector<std::size_t>, std::greater<std::size_t>>;
+    std::array<min_heap, max_gap + 1> gaps;
+
+    std::vector<std::size_t> file_positions;
+    file_positions.reserve(disk_map.size() / 2 + 1);
+    std::size_t position = 0;
+    for (std::size_t i = 0; i < disk_map.size(); ++i) {
+        if (i % 2 == 0) {
+            file_positions.push_back(position);
+        } else if (disk_map[i] > 0) {
+            gaps[disk_map[i]].push(position);
+        }
+        position += disk_map[i];
+    }
+
+    ChecksumType total = 0;
+    for (auto file_id = file_positions.size(); file_id-- > 0;) {
+        const std::size_t length = disk_map[2 * file_id];
+        auto file_position = file_positions[file_id];
+
+        std::size_t best_size = 0;
+        for (auto size = std::max<std::size_t>(length, 1); size <= max_gap; ++size) {
+            if (!gaps[size].empty() && gaps[size].top() < file_position &&
+                (best_size == 0 || gaps[size].top() < gaps[best_size].top())) {
+                best_size = size;
+            }
+        }
+
+        if (best_size != 0 && length > 0) {
+            file_position = gaps[best_size].top();
+            gaps[best_size].pop();
+            if (best_size > length) {
+                gaps[best_size - length].push(file_position + length);
+            }
         }
+        total += extent_checksum(file_id, file_position, length);
     }
     return total;
 }
 
-// Length file - length free space
 int main() {
     const auto input = read_input(std::cin);
-    const auto blocks = disk_map_to_blocks(input);
-    const auto blocks_compacted = compact_disk(blocks);
 
-    std::clog << "Part 1: " << checksum(blocks_compacted) << "\n";
+    std::clog << "Part 1: " << to_string(compact_disk_checksum(input)) << "\n";
+    std::clog << "Part 2: " << to_string(compact_files_checksum(input)) << "\n";
 
     return 0;
 }
@@ -32,3 +32,24 @@ TEST_CASE("test_parse_input_incomplete_line", "[parsing]") {
     std::istringstream ss("1 2\n3\n5 6");
     REQUIRE_THROWS(parse_input<int, int>(ss));
 }
+
+#define main day7_main
+#include "day7.cpp"
+#undef main
+
+TEST_CASE("test_day7_narrow_overflow", "[day7]") {
+    // Every equation has a solution whose intermediate value does not fit into 64 bits
+    std::istringstream ss("4611686018427387904: 4611686018427387904 2 -4611686018427387904\n"
+                          "4611686018427387904: 4611686018427387904 4611686018427387904 "
+                          "4611686018427387904\n"
+                          "-4611686018427387905: -4611686018427387905 -4611686018427387905 "
+                          "-4611686018427387905\n");
+    const auto equations = read_input(ss);
+
+    const auto basic = solve_batched<operator_set<add, multiply>>(equations, true);
+    REQUIRE(basic[0].num_assignments == 1);
+
+    const auto with_subtract = solve_batched<operator_set<add, subtract>>(equations, true);
+    REQUIRE(with_subtract[1].num_assignments == 2);
+    REQUIRE(with_subtract[2].num_assignments == 2);
+}